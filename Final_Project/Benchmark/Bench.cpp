@@ -0,0 +1,195 @@
+#include "../StorageEngine/Metrics.h"
+#include "../StorageEngine/StorageEngine.h"
+#include "../StorageEngine/Testcase.h"
+#include "../StorageEngine/Trace.h"
+#include "../StudentComponent/LogMgr.h"
+#include "BenchUtil.h"
+#include "RecoverySweep.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Benchmark harness.
+ *
+ * Runs a testcase (e.g. one from workloadgen.o) through StorageEngine and
+ * LogMgr in-process, timing every operation, and prints one JSON object:
+ * throughput, latency percentiles for write, commit, abort and
+ * checkpoint, time per recovery phase summed over all restarts, and log
+ * and buffer pool counters, and the Metrics.h counters when built with
+ * make metrics. The output files are written as by main.o.
+ *
+ * usage: bench.o testcase [driver options]
+ *        bench.o --recovery-sweep [sweep options]; see RecoverySweep.h
+ */
+
+typedef chrono::steady_clock Clock;
+
+static double nanosSince(Clock::time_point start) {
+  return chrono::duration<double, nano>(Clock::now() - start).count();
+}
+
+static void printLatency(const string& name, vector<double>& ns, bool last) {
+  sort(ns.begin(), ns.end());
+  double total = 0;
+  for (unsigned i = 0; i < ns.size(); ++i)
+    total += ns[i];
+  cout << "    \"" << name << "\": {\"count\": " << ns.size()
+       << ", \"mean\": " << (ns.empty() ? 0 : total / ns.size())
+       << ", \"p50\": " << percentile(ns, 0.50)
+       << ", \"p99\": " << percentile(ns, 0.99)
+       << ", \"p999\": " << percentile(ns, 0.999)
+       << ", \"max\": " << (ns.empty() ? 0 : ns.back()) << "}"
+       << (last ? "" : ",") << endl;
+}
+
+static string jsonString(const string& s) {
+  string out = "\"";
+  for (unsigned i = 0; i < s.length(); ++i) {
+    if (s[i] == '"' || s[i] == '\\')
+      out += '\\';
+    out += s[i];
+  }
+  return out + "\"";
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    cerr << "usage: " << argv[0] << " testcase " << DRIVER_OPTIONS_USAGE << endl;
+    cerr << "       " << argv[0] << " --recovery-sweep [--sizes n,n,...] [--checkpoint-every n,n,...]"
+	 << " [--points n] [--sequences \"n n;n\"] [--pages n] [--concurrency n] [--seed s]"
+	 << " [--full-restarts]" << endl;
+    return 1;
+  }
+  if (string(argv[1]) == "--recovery-sweep")
+    return runRecoverySweep(argc, argv);
+  string filename = argv[1];
+  DriverOptions options;
+  if (!parseOptions(argc, argv, 2, {},
+		    [&](int argc, char *argv[], int& i) { return parseDriverOption(argc, argv, i, options); },
+		    [](const string&, const char*) { return false; }))
+    return 1;
+
+  // Read the whole script first so parsing is not timed.
+  ifstream myfile(filename);
+  string db_filename;
+  if (!getline(myfile, db_filename)) {
+    cerr << "cannot read " << filename << endl;
+    return 1;
+  }
+  vector<TestcaseOp> ops;
+  string contents;
+  while (getline(myfile, contents) && contents != "")
+    ops.push_back(parseTestcaseLine(contents));
+  myfile.close();
+
+  StorageEngine se;
+  applyDriverOptions(options, se);
+  LogMgr* lm = new LogMgr();
+  lm->setStorageEngine(&se);
+  se.start(db_filename, lm, filename.substr(filename.length() - 2));
+
+  vector<double> write_ns, commit_ns, abort_ns, checkpoint_ns;
+  long crashes = 0, restarts = 0, completed = 0;
+  double recovery_ns = 0;
+  RecoveryStats phases;
+  double log_read_seconds = 0;
+
+  Clock::time_point start = Clock::now();
+  for (unsigned k = 0; k < ops.size(); ++k) {
+    const TestcaseOp& op = ops[k];
+    Clock::time_point t0 = Clock::now();
+    if (op.type == OP_WRITE) {
+      se.write(op.txid, op.page_id, op.offset, op.text);
+      write_ns.push_back(nanosSince(t0));
+    } else if (op.type == OP_COMMIT) {
+      lm->commit(op.txid);
+      commit_ns.push_back(nanosSince(t0));
+    } else if (op.type == OP_ABORT) {
+      se.abort(op.txid, op.pages_allowed);
+      abort_ns.push_back(nanosSince(t0));
+    } else if (op.type == OP_CHECKPOINT) {
+      lm->checkpoint();
+      checkpoint_ns.push_back(nanosSince(t0));
+    } else if (op.type == OP_CRASH) {
+      ++crashes;
+      double read_before = se.getLogIOStats().read_seconds;
+      lm = crashAndRestart(se, lm, op.safe_writes, false,
+			   [&](unsigned, const RecoveryStats& rs) {
+			     addRecoveryStats(phases, rs);
+			     completed += rs.redone ? 1 : 0;
+			     ++restarts;
+			   });
+      log_read_seconds += se.getLogIOStats().read_seconds - read_before;
+      recovery_ns += nanosSince(t0);
+    } else if (op.type == OP_END) {
+      se.end(se.getOutputFileName());
+      break;
+    }
+  }
+  double wall = chrono::duration<double>(Clock::now() - start).count();
+  long timed = write_ns.size() + commit_ns.size() + abort_ns.size() + checkpoint_ns.size();
+
+  LogIOStats log = se.getLogIOStats();
+  BufferStats buffer = se.getBufferStats();
+  FlushControlStats control = se.getFlushControlStats();
+  unsigned long lookups = buffer.hits + buffer.misses;
+
+  cout << "{" << endl;
+  cout << "  \"testcase\": " << jsonString(filename) << "," << endl;
+  cout << "  \"options\": {\"diff_log\": " << (options.diff_log ? "true" : "false")
+       << ", \"compress_log\": " << (options.compress_log ? "true" : "false")
+       << ", \"log_segment_bytes\": " << options.log_segment_bytes << "}," << endl;
+  cout << "  \"ops\": " << timed << "," << endl;
+  cout << "  \"wall_seconds\": " << wall << "," << endl;
+  cout << "  \"ops_per_sec\": " << (wall > 0 ? timed / wall : 0) << "," << endl;
+  cout << "  \"latency_ns\": {" << endl;
+  printLatency("write", write_ns, false);
+  printLatency("commit", commit_ns, false);
+  printLatency("abort", abort_ns, false);
+  printLatency("checkpoint", checkpoint_ns, true);
+  cout << "  }," << endl;
+  cout << "  \"recovery\": {\"crashes\": " << crashes
+       << ", \"restarts\": " << restarts
+       << ", \"completed\": " << completed
+       << ", \"wall_ms\": " << recovery_ns / 1e6
+       << ", \"log_read_ms\": " << log_read_seconds * 1000
+       << ", \"parse_ms\": " << phases.parse_seconds * 1000
+       << ", \"analyze_ms\": " << phases.analyze_seconds * 1000
+       << ", \"redo_ms\": " << phases.redo_seconds * 1000
+       << ", \"undo_ms\": " << phases.undo_seconds * 1000
+       << ", \"deferred_pages\": " << phases.deferred_pages
+       << ", \"deferred_losers\": " << phases.deferred_losers << "}," << endl;
+  cout << "  \"log\": {\"flushes\": " << log.flushes
+       << ", \"raw_bytes\": " << log.raw_bytes
+       << ", \"stored_bytes\": " << log.stored_bytes
+       << ", \"flush_ms\": " << log.flush_seconds * 1000
+       << ", \"segments_removed\": " << log.segments_removed << "}," << endl;
+  cout << "  \"buffer\": {\"hits\": " << buffer.hits
+       << ", \"misses\": " << buffer.misses
+       << ", \"evictions\": " << buffer.evictions
+       << ", \"hit_rate\": " << (lookups ? (double)buffer.hits / lookups : 0) << "}," << endl;
+  cout << "  \"flush_control\": {\"target_ms\": " << options.recovery_target_ms
+       << ", \"checks\": " << control.checks
+       << ", \"pages_written\": " << control.pages_written
+       << ", \"redo_bytes\": " << control.redo_bytes
+       << ", \"estimate_ms\": " << control.estimate_ms
+       << ", \"max_estimate_ms\": " << control.max_estimate_ms << "}";
+#ifdef DB_METRICS
+  cout << "," << endl << "  \"metrics\": {";
+  for (int i = 0; i < METRIC_COUNT; ++i)
+    cout << (i ? ", " : "") << "\"" << metrics::name((MetricId)i) << "\": "
+	 << metrics::read((MetricId)i);
+  cout << "}";
+#endif
+  cout << endl << "}" << endl;
+
+  delete lm;
+  trace::finish();
+  return 0;
+}
@@ -0,0 +1,114 @@
+#ifndef BENCHUTIL_H_
+#define BENCHUTIL_H_
+
+#include "../StorageEngine/StorageEngine.h"
+#include "../StudentComponent/LogMgr.h"
+#include <algorithm>
+#include <cstdio>
+#include <glob.h>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Helpers shared by the benchmarks in this directory.
+ */
+
+// The p-th quantile (0 to 1) of an ascending vector; 0 if it is empty.
+inline double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  return sorted[(size_t)(p * (sorted.size() - 1))];
+}
+
+/*
+ * Hands each option from argv[first] on to take(arg, value) and returns
+ * true if all were accepted. Options listed in flags get value NULL; any
+ * other takes the argument after it. take returns false for an option it
+ * does not know. before(argc, argv, i), if given, may claim argv[i]
+ * first (e.g. parseDriverOption), advancing i past any value it takes.
+ * Prints what went wrong to cerr on a missing value or unknown option.
+ */
+template <typename Before, typename Take>
+inline bool parseOptions(int argc, char *argv[], int first,
+			 std::initializer_list<std::string> flags, Before before, Take take) {
+  for (int i = first; i < argc; ++i) {
+    if (before(argc, argv, i))
+      continue;
+    std::string arg = argv[i];
+    bool flag = std::find(flags.begin(), flags.end(), arg) != flags.end();
+    if (!flag && i + 1 >= argc) {
+      std::cerr << "missing value for " << arg << std::endl;
+      return false;
+    }
+    if (!take(arg, flag ? NULL : argv[++i])) {
+      std::cerr << "unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename Take>
+inline bool parseOptions(int argc, char *argv[], int first,
+			 std::initializer_list<std::string> flags, Take take) {
+  return parseOptions(argc, argv, first, flags,
+		      [](int, char **, int&) { return false; }, take);
+}
+
+/*
+ * Removes output/log/log<testcase_num>.log and every segment of it
+ * (output/log/log<testcase_num>.<first>-<last>.log), so a run starts
+ * from an empty log whether or not the last one was segmented.
+ */
+inline void removeLog(const std::string& testcase_num) {
+  std::string prefix = "output/log/log" + testcase_num;
+  remove((prefix + ".log").c_str());
+  glob_t segments;
+  if (glob((prefix + ".*.log").c_str(), 0, NULL, &segments) == 0)
+    for (size_t i = 0; i < segments.gl_pathc; ++i)
+      remove(segments.gl_pathv[i]);
+  globfree(&segments);
+}
+
+// Adds the per-phase times and counters of one restart to total.
+inline void addRecoveryStats(RecoveryStats& total, const RecoveryStats& rs) {
+  total.parse_seconds += rs.parse_seconds;
+  total.analyze_seconds += rs.analyze_seconds;
+  total.redo_seconds += rs.redo_seconds;
+  total.undo_seconds += rs.undo_seconds;
+  total.reused_records += rs.reused_records;
+  total.deferred_pages += rs.deferred_pages;
+  total.deferred_losers += rs.deferred_losers;
+}
+
+/*
+ * As crash() in Testcase.cpp, but deleting lm first and calling
+ * restarted(i, stats) with the RecoveryStats of each restart: one
+ * restart per pageWrite budget in budgets, each resuming the one it
+ * interrupted unless full_restarts. Ends the crash and returns the
+ * LogMgr that finished recovery.
+ */
+template <typename Restarted>
+inline LogMgr* crashAndRestart(StorageEngine& se, LogMgr* lm, const std::vector<int>& budgets,
+			       bool full_restarts, Restarted restarted) {
+  delete lm;
+  lm = NULL;
+  for (unsigned i = 0; i < budgets.size(); ++i) {
+    LogMgr* interrupted = lm;
+    lm = new LogMgr();
+    lm->setStorageEngine(&se);
+    if (interrupted) {
+      if (!full_restarts)
+	lm->resumeRecovery(*interrupted);
+      delete interrupted;
+    }
+    se.crash(budgets[i], lm);
+    restarted(i, lm->getRecoveryStats());
+  }
+  se.end_crash(lm);
+  return lm;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "../StorageEngine/StorageEngine.h"
+#include "../StudentComponent/LogMgr.h"
+#include "BenchUtil.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace std;
+
+/*
+ * Log volume benchmark.
+ *
+ * Runs committed update transactions with occasional checkpoints, then
+ * crashes and recovers. Reports how many log bytes were produced and
+ * stored, the compression ratio, and the time spent flushing the log,
+ * reading it back and recovering.
+ *
+ * usage: logbench.o [--db file] [--txns n] [--writes n] [--compress]
+ *                   [--diff-log] [--segment-bytes n] [--seed s]
+ */
+
+int main(int argc, char *argv[]) {
+  string db_filename = "StorageEngine/sampleDBFile.txt";
+  int txns = 20000;
+  int writes = 4;
+  bool compress = false;
+  bool diff_log = false;
+  unsigned long segment_bytes = 0;
+  unsigned seed = 484;
+
+  bool parsed = parseOptions(argc, argv, 1, {"--compress", "--diff-log"},
+			     [&](const string& arg, const char* val) {
+    if (arg == "--compress") compress = true;
+    else if (arg == "--diff-log") diff_log = true;
+    else if (arg == "--db") db_filename = val;
+    else if (arg == "--txns") txns = atoi(val);
+    else if (arg == "--writes") writes = atoi(val);
+    else if (arg == "--segment-bytes") segment_bytes = strtoul(val, NULL, 10);
+    else if (arg == "--seed") seed = (unsigned)atoi(val);
+    else return false;
+    return true;
+  });
+  if (!parsed)
+    return 1;
+
+  string testcase_num = compress ? "lz" : "lb";
+  if (segment_bytes > 0)
+    testcase_num += "s";
+  removeLog(testcase_num);
+
+  StorageEngine se;
+  se.setLogCompression(compress);
+  se.setDiffLogging(diff_log);
+  se.setLogSegmentBytes(segment_bytes, false);
+  LogMgr* lm = new LogMgr();
+  lm->setStorageEngine(&se);
+  se.start(db_filename, lm, testcase_num);
+
+  int pages = 0;
+  while (!se.read(0, pages + 1, 0, 1).empty())
+    ++pages;
+  if (pages == 0) {
+    cerr << "no pages in " << db_filename << endl;
+    return 1;
+  }
+
+  static const char* words[] = {"one", "two", "three", "four", "five", "six",
+				"seven", "eight", "nine", "ten", "xxxx"};
+  mt19937 rng(seed);
+  uniform_int_distribution<int> any_page(1, pages);
+  uniform_int_distribution<int> any_offset(0, 30);
+  uniform_int_distribution<int> any_word(0, 10);
+
+  for (int tx = 1; tx <= txns; ++tx) {
+    for (int w = 0; w < writes; ++w)
+      se.write(tx, any_page(rng), any_offset(rng), words[any_word(rng)]);
+    lm->commit(tx);
+    if (tx % 1000 == 0)
+      lm->checkpoint();
+  }
+
+  LogIOStats before_crash = se.getLogIOStats();
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  LogMgr* recovered = new LogMgr();
+  recovered->setStorageEngine(&se);
+  se.crash(1 << 30, recovered);
+  se.end_crash(recovered);
+  chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+  LogIOStats stats = se.getLogIOStats();
+
+  se.end("output/dbs/db" + testcase_num + ".db");
+
+  cout << "mode " << (compress ? "compressed" : "plain") << endl;
+  cout << "flushes " << before_crash.flushes << endl;
+  cout << "raw_bytes " << before_crash.raw_bytes << endl;
+  cout << "stored_bytes " << before_crash.stored_bytes << endl;
+  cout << "ratio " << (before_crash.stored_bytes ? 
+		       (double)before_crash.raw_bytes / before_crash.stored_bytes : 0) << endl;
+  cout << "flush_ms " << before_crash.flush_seconds * 1000 << endl;
+  cout << "log_read_ms " << (stats.read_seconds - before_crash.read_seconds) * 1000 << endl;
+  cout << "segments_removed " << stats.segments_removed << endl;
+  cout << "recover_ms " << chrono::duration<double, milli>(t1 - t0).count() << endl;
+
+  delete lm;
+  delete recovered;
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include "../StorageEngine/StorageEngine.h"
+#include "../StudentComponent/LogMgr.h"
+#include "BenchUtil.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Page store benchmark: in memory, in a page file through the OS page
+ * cache, or in a page file opened with O_DIRECT.
+ *
+ * Builds a database of --pages pages, many more than the buffer pool
+ * holds, and runs random reads and writes over it. Reports throughput,
+ * buffer pool misses and evictions, and how much of the page file the
+ * OS page cache holds at the end, which is memory spent on top of the
+ * buffer pool. With --writeback-every, dirty pages are also written
+ * back in batches, through --async-io if given.
+ *
+ * usage: pagefilebench.o [--mode memory|buffered|direct] [--pages n]
+ *                        [--page-size bytes] [--ops n] [--read-ratio r]
+ *                        [--file path] [--async-io uring|threads]
+ *                        [--writeback-every ops] [--seed s]
+ */
+
+// KiB of filename resident in the OS page cache.
+static long cachedKiB(const string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  long kib = -1;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map != MAP_FAILED) {
+      long page = sysconf(_SC_PAGESIZE);
+      vector<unsigned char> resident((st.st_size + page - 1) / page);
+      if (mincore(map, st.st_size, &resident[0]) == 0) {
+        kib = 0;
+        for (unsigned i = 0; i < resident.size(); ++i)
+          kib += (resident[i] & 1) ? page / 1024 : 0;
+      }
+      munmap(map, st.st_size);
+    }
+  }
+  close(fd);
+  return kib;
+}
+
+int main(int argc, char *argv[]) {
+  string mode = "buffered";
+  int pages = 20000;
+  int page_size = 1024;
+  long ops = 200000;
+  double read_ratio = 0.7;
+  string page_filename = "output/dbs/pagefile.pages";
+  string async_io;
+  long writeback_every = 0;
+  unsigned seed = 484;
+
+  bool parsed = parseOptions(argc, argv, 1, {}, [&](const string& arg, const char* val) {
+    if (arg == "--mode") mode = val;
+    else if (arg == "--pages") pages = atoi(val);
+    else if (arg == "--page-size") page_size = atoi(val);
+    else if (arg == "--ops") ops = atol(val);
+    else if (arg == "--read-ratio") read_ratio = atof(val);
+    else if (arg == "--file") page_filename = val;
+    else if (arg == "--async-io") async_io = val;
+    else if (arg == "--writeback-every") writeback_every = atol(val);
+    else if (arg == "--seed") seed = (unsigned)atoi(val);
+    else return false;
+    return true;
+  });
+  if (!parsed)
+    return 1;
+  if (mode != "memory" && mode != "buffered" && mode != "direct") {
+    cerr << "--mode must be memory, buffered or direct" << endl;
+    return 1;
+  }
+  if (pages < 1 || page_size < 16 || page_size > (int)PageFile::capacity()) {
+    cerr << "--pages must be positive and --page-size from 16 to "
+         << PageFile::capacity() << endl;
+    return 1;
+  }
+
+  // one spare line, as the engine cannot address the last page of a file
+  string db_filename = "output/dbs/pagefile_in.db";
+  ofstream db(db_filename);
+  for (int i = 0; i <= pages; ++i)
+    db << -1 << ' ' << string(page_size, 'x') << '\n';
+  db.close();
+
+  removeLog("pf");
+  StorageEngine se;
+  if (mode != "memory")
+    se.setPageFile(page_filename, mode == "direct");
+  if (!async_io.empty())
+    se.setAsyncIO(true, async_io == "uring");
+  LogMgr* lm = new LogMgr();
+  lm->setStorageEngine(&se);
+  se.start(db_filename, lm, "pf");
+  se.resetBufferStats();
+
+  mt19937 rng(seed);
+  uniform_real_distribution<double> coin(0.0, 1.0);
+  uniform_int_distribution<int> any_page(1, pages);
+  uniform_int_distribution<int> any_offset(0, page_size - 16);
+  string text(16, 'w');
+  unsigned long checksum = 0;
+  long writes = 0;
+  int txid = 1;
+  unsigned long written_back = 0;
+
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (long op = 0; op < ops; ++op) {
+    if (writeback_every > 0 && op % writeback_every == 0)
+      written_back += se.writeBackDirtyPages(-1);
+    int page_id = any_page(rng);
+    int offset = any_offset(rng);
+    if (coin(rng) < read_ratio) {
+      PageView view = se.readView(txid, page_id, offset, 16);
+      checksum += view.length > 0 ? (unsigned char)view.data[0] : 0;
+      se.unpin(view);
+      continue;
+    }
+    se.write(txid, page_id, offset, text);
+    if (++writes % 16 == 0) {
+      lm->commit(txid);
+      ++txid;
+    }
+  }
+  lm->commit(txid);
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  BufferStats stats = se.getBufferStats();
+  cout << "mode " << mode << endl;
+  if (mode == "direct")
+    cout << "o_direct " << (se.pageFileDirect() ? "yes" : "refused, fell back to buffered") << endl;
+  cout << "pages " << pages << endl;
+  cout << "ops " << ops << endl;
+  cout << "seconds " << seconds << endl;
+  cout << "ops_per_sec " << (seconds > 0 ? ops / seconds : 0) << endl;
+  cout << "misses " << stats.misses << endl;
+  cout << "evictions " << stats.evictions << endl;
+  cout << "async_io " << se.asyncIOBackend() << endl;
+  cout << "written_back " << written_back << endl;
+  if (mode != "memory")
+    cout << "page_cache_kib " << cachedKiB(page_filename) << endl;
+  cout << "checksum " << checksum << endl;
+
+  delete lm;
+  remove(db_filename.c_str());
+  if (mode != "memory")
+    remove(page_filename.c_str());
+  return 0;
+}
@@ -0,0 +1,141 @@
+#include "../StudentComponent/LogRecord.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Log parser benchmark.
+ *
+ * Builds a text log of update, CLR, commit, end and checkpoint records,
+ * then parses it twice: line by line through an istringstream and
+ * LogRecord::stringToRecordPtr, as stringToLRVector used to, and with
+ * memchr and LogRecord::parseRecord, as it does now. Reports records/sec
+ * for both and checks that every record prints back the same.
+ *
+ * usage: parsebench.o [--records n] [--pages n] [--seed s]
+ */
+
+static string buildLog(long records, int pages, unsigned seed) {
+  static const char* words[] = {"one", "two", "three", "four", "five", "six",
+				"seven", "eight", "nine", "ten", "xxxx"};
+  mt19937 rng(seed);
+  uniform_int_distribution<int> any_page(1, pages);
+  uniform_int_distribution<int> any_offset(0, 30);
+  uniform_int_distribution<int> any_word(0, 10);
+  uniform_int_distribution<int> any_outcome(0, 9);
+
+  string log;
+  long lsn = 0;
+  int tx = 0;
+  DenseTable<txTableEntry> tx_table;
+  DenseTable<int> dirty_page_table;
+  while (lsn < records) {
+    ++tx;
+    int last = -1;
+    vector<LogRecord*> updates;
+    for (int w = 0; w < 4; ++w) {
+      int page = any_page(rng);
+      UpdateLogRecord* update = new UpdateLogRecord(lsn, last, tx, page, any_offset(rng),
+						    words[any_word(rng)], words[any_word(rng)]);
+      log += update->toString();
+      dirty_page_table.insert(page, lsn);
+      updates.push_back(update);
+      last = lsn++;
+    }
+    tx_table[tx] = txTableEntry(last, U);
+    if (any_outcome(rng) == 0) { //roll back
+      for (int w = (int)updates.size() - 1; w >= 0; --w) {
+	UpdateLogRecord* update = (UpdateLogRecord*)updates[w];
+	CompensationLogRecord clr(lsn, last, tx, update->getPageID(), update->getOffset(),
+				  update->getBeforeImage(), update->getprevLSN());
+	log += clr.toString();
+	last = lsn++;
+      }
+    } else {
+      log += LogRecord(lsn, last, tx, COMMIT).toString();
+      last = lsn++;
+    }
+    log += LogRecord(lsn++, last, tx, END).toString();
+    for (unsigned w = 0; w < updates.size(); ++w)
+      delete updates[w];
+    if (tx % 1000 == 0) {
+      log += LogRecord(lsn, -1, -1, BEGIN_CKPT).toString();
+      log += ChkptLogRecord(lsn + 1, lsn, -1, tx_table, dirty_page_table).toString();
+      lsn += 2;
+      tx_table.clear();
+      dirty_page_table.clear();
+    }
+    tx_table.erase(tx);
+  }
+  return log;
+}
+
+int main(int argc, char *argv[]) {
+  long records = 2000000;
+  int pages = 100;
+  unsigned seed = 484;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      cerr << "missing value for " << arg << endl;
+      return 1;
+    }
+    if (arg == "--records") records = atol(argv[++i]);
+    else if (arg == "--pages") pages = atoi(argv[++i]);
+    else if (arg == "--seed") seed = (unsigned)atoi(argv[++i]);
+    else {
+      cerr << "unknown option " << arg << endl;
+      return 1;
+    }
+  }
+
+  string log = buildLog(records, pages, seed);
+
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  vector<LogRecord*> streamed;
+  istringstream stream(log);
+  string line;
+  while (getline(stream, line))
+    streamed.push_back(LogRecord::stringToRecordPtr(line));
+
+  chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+  vector<LogRecord*> scanned;
+  const char* at = log.data();
+  const char* end = at + log.length();
+  while (at != end) {
+    const char* newline = (const char*)memchr(at, '\n', end - at);
+    const char* line_end = newline ? newline : end;
+    scanned.push_back(LogRecord::parseRecord(at, line_end - at));
+    at = newline ? newline + 1 : end;
+  }
+  chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+
+  bool identical = streamed.size() == scanned.size();
+  for (size_t i = 0; identical && i < scanned.size(); ++i)
+    identical = streamed[i]->toString() == scanned[i]->toString();
+
+  double stream_s = chrono::duration<double>(t1 - t0).count();
+  double scan_s = chrono::duration<double>(t2 - t1).count();
+  cout << "records " << scanned.size() << endl;
+  cout << "bytes " << log.length() << endl;
+  cout << "stream_ms " << stream_s * 1000 << endl;
+  cout << "stream_records_per_sec " << (stream_s > 0 ? scanned.size() / stream_s : 0) << endl;
+  cout << "fast_ms " << scan_s * 1000 << endl;
+  cout << "fast_records_per_sec " << (scan_s > 0 ? scanned.size() / scan_s : 0) << endl;
+  cout << "speedup " << (scan_s > 0 ? stream_s / scan_s : 0) << endl;
+  cout << "identical " << (identical ? "yes" : "no") << endl;
+
+  for (size_t i = 0; i < streamed.size(); ++i)
+    delete streamed[i];
+  for (size_t i = 0; i < scanned.size(); ++i)
+    delete scanned[i];
+  return identical ? 0 : 1;
+}
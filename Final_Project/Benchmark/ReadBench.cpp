@@ -0,0 +1,124 @@
+#include "../StorageEngine/StorageEngine.h"
+#include "../StudentComponent/LogMgr.h"
+#include "BenchUtil.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Read-mostly benchmark for the buffer pool read path.
+ *
+ * Runs a mix of reads and writes against a database file and reports the
+ * buffer pool hit rate and per-read latency. A fraction of the accesses
+ * go to a small hot set of pages so the hit rate can be tuned.
+ *
+ * usage: readbench.o [--db file] [--ops n] [--read-ratio r] [--hot pages]
+ *                    [--hot-ratio r] [--len bytes] [--copy] [--seed s]
+ */
+
+int main(int argc, char *argv[]) {
+  string db_filename = "StorageEngine/sampleDBFile.txt";
+  long ops = 200000;
+  double read_ratio = 0.95;
+  int hot_pages = 8;
+  double hot_ratio = 0.9;
+  int len = 16;
+  bool copy = false;
+  unsigned seed = 484;
+
+  bool parsed = parseOptions(argc, argv, 1, {"--copy"}, [&](const string& arg, const char* val) {
+    if (arg == "--copy") copy = true;
+    else if (arg == "--db") db_filename = val;
+    else if (arg == "--ops") ops = atol(val);
+    else if (arg == "--read-ratio") read_ratio = atof(val);
+    else if (arg == "--hot") hot_pages = atoi(val);
+    else if (arg == "--hot-ratio") hot_ratio = atof(val);
+    else if (arg == "--len") len = atoi(val);
+    else if (arg == "--seed") seed = (unsigned)atoi(val);
+    else return false;
+    return true;
+  });
+  if (!parsed)
+    return 1;
+
+  StorageEngine se;
+  LogMgr* lm = new LogMgr();
+  lm->setStorageEngine(&se);
+  se.start(db_filename, lm, "rb");
+
+  // Count pages the same way the engine does: ids run from 1 and the
+  // last line of the file is not addressable.
+  int pages = 0;
+  while (!se.read(0, pages + 1, 0, 1).empty())
+    ++pages;
+  if (pages == 0) {
+    cerr << "no pages in " << db_filename << endl;
+    return 1;
+  }
+  hot_pages = max(1, min(hot_pages, pages));
+  se.resetBufferStats();
+
+  mt19937 rng(seed);
+  uniform_real_distribution<double> coin(0.0, 1.0);
+  uniform_int_distribution<int> any_page(1, pages);
+  uniform_int_distribution<int> hot_page(1, hot_pages);
+
+  vector<double> read_ns;
+  read_ns.reserve(ops);
+  long writes = 0;
+  unsigned long checksum = 0;
+  int txid = 1;
+  string text(len, 'w');
+
+  for (long op = 0; op < ops; ++op) {
+    int page_id = coin(rng) < hot_ratio ? hot_page(rng) : any_page(rng);
+    if (coin(rng) >= read_ratio) {
+      se.write(txid, page_id, 0, text);
+      if (++writes % 16 == 0) {
+        lm->commit(txid);
+        ++txid;
+      }
+      continue;
+    }
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    if (copy) {
+      string bytes = se.read(txid, page_id, 0, len);
+      checksum += bytes.empty() ? 0 : (unsigned char)bytes[0];
+    } else {
+      PageView view = se.readView(txid, page_id, 0, len);
+      checksum += view.length > 0 ? (unsigned char)view.data[0] : 0;
+      se.unpin(view);
+    }
+    chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+    read_ns.push_back(chrono::duration<double, nano>(t1 - t0).count());
+  }
+  lm->commit(txid);
+
+  BufferStats stats = se.getBufferStats();
+  sort(read_ns.begin(), read_ns.end());
+  double total = 0;
+  for (unsigned i = 0; i < read_ns.size(); ++i)
+    total += read_ns[i];
+  unsigned long lookups = stats.hits + stats.misses;
+
+  cout << "mode " << (copy ? "read" : "readView") << endl;
+  cout << "pages " << pages << endl;
+  cout << "reads " << read_ns.size() << endl;
+  cout << "writes " << writes << endl;
+  cout << "hit_rate " << (lookups ? (double)stats.hits / lookups : 0) << endl;
+  cout << "evictions " << stats.evictions << endl;
+  cout << "read_ns_mean " << (read_ns.empty() ? 0 : total / read_ns.size()) << endl;
+  cout << "read_ns_p50 " << percentile(read_ns, 0.50) << endl;
+  cout << "read_ns_p99 " << percentile(read_ns, 0.99) << endl;
+  cout << "checksum " << checksum << endl;
+
+  delete lm;
+  return 0;
+}
@@ -0,0 +1,188 @@
+#include "RecoverySweep.h"
+#include "BenchUtil.h"
+#include "../StorageEngine/StorageEngine.h"
+#include "../StorageEngine/Testcase.h"
+#include "../StorageEngine/Trace.h"
+#include "../StudentComponent/LogMgr.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct SweepOptions {
+  int pages;
+  vector<long> sizes;
+  vector<long> checkpoint_every;
+  int points;
+  vector<vector<int> > sequences;
+  int concurrency;
+  unsigned seed;
+  bool full_restarts;
+  DriverOptions driver;
+
+  SweepOptions() {
+    pages = 1000;
+    sizes.push_back(2000);
+    sizes.push_back(8000);
+    sizes.push_back(32000);
+    checkpoint_every.push_back(0);
+    checkpoint_every.push_back(4000);
+    checkpoint_every.push_back(500);
+    points = 4;
+    sequences.push_back(vector<int>(1, UNLIMITED_PAGE_WRITES));
+    int nested[] = {7, 3, UNLIMITED_PAGE_WRITES};
+    sequences.push_back(vector<int>(nested, nested + 3));
+    concurrency = 8;
+    seed = 484;
+    full_restarts = false;
+  }
+};
+
+static vector<long> parseList(const string& s) {
+  vector<long> out;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, ','))
+    out.push_back(atol(item.c_str()));
+  return out;
+}
+
+// "7 3 2;0" is two sequences: crash {7 3 2} and crash {0}
+static vector<vector<int> > parseSequences(const string& s) {
+  vector<vector<int> > out;
+  stringstream ss(s);
+  string item;
+  while (getline(ss, item, ';')) {
+    stringstream ss2(item);
+    vector<int> seq;
+    int n;
+    while (ss2 >> n)
+      seq.push_back(n);
+    if (!seq.empty())
+      out.push_back(seq);
+  }
+  return out;
+}
+
+/*
+ * Builds a log of crash_after updates, then crashes with the given
+ * sequence of pageWrite budgets and prints one JSON row for it.
+ */
+static void runPoint(const SweepOptions& opt, const string& db_filename, long size,
+		     long checkpoint_every, long crash_after, const vector<int>& sequence,
+		     bool last) {
+  removeLog("sw");
+  StorageEngine se;
+  applyDriverOptions(opt.driver, se);
+  LogMgr* lm = new LogMgr();
+  lm->setStorageEngine(&se);
+  se.start(db_filename, lm, "sw");
+
+  mt19937 rng(opt.seed);
+  uniform_int_distribution<int> any_page(1, opt.pages);
+  uniform_int_distribution<int> any_offset(0, 24);
+  uniform_int_distribution<int> any_tx(0, opt.concurrency - 1);
+  vector<int> txids(opt.concurrency);
+  vector<int> writes(opt.concurrency, 0);
+  for (int i = 0; i < opt.concurrency; ++i)
+    txids[i] = i + 1;
+  int next_txid = opt.concurrency + 1;
+
+  for (long w = 1; w <= crash_after; ++w) {
+    int slot = any_tx(rng);
+    se.write(txids[slot], any_page(rng), any_offset(rng), "sweep");
+    if (++writes[slot] == 4) {
+      lm->commit(txids[slot]);
+      txids[slot] = next_txid++;
+      writes[slot] = 0;
+    }
+    if (checkpoint_every > 0 && w % checkpoint_every == 0)
+      lm->checkpoint();
+  }
+
+  RecoveryStats total, first;
+  int completed = 0;
+  Clock::time_point start = Clock::now();
+  lm = crashAndRestart(se, lm, sequence, opt.full_restarts,
+		       [&](unsigned i, const RecoveryStats& rs) {
+			 if (i == 0)
+			   first = rs;
+			 addRecoveryStats(total, rs);
+			 completed += rs.redone ? 1 : 0;
+		       });
+  double recovery_ms = chrono::duration<double, milli>(Clock::now() - start).count();
+
+  cout << "    {\"log_size\": " << size
+       << ", \"checkpoint_every\": " << checkpoint_every
+       << ", \"crash_after\": " << crash_after
+       << ", \"sequence\": [";
+  for (unsigned i = 0; i < sequence.size(); ++i)
+    cout << (i ? ", " : "") << sequence[i];
+  cout << "], \"log_records\": " << first.log_records
+       << ", \"dirty_pages\": " << first.dirty_pages
+       << ", \"restarts\": " << sequence.size()
+       << ", \"redo_completed\": " << completed
+       << ", \"reused_records\": " << total.reused_records
+       << ", \"recovery_ms\": " << recovery_ms
+       << ", \"parse_ms\": " << total.parse_seconds * 1000
+       << ", \"analyze_ms\": " << total.analyze_seconds * 1000
+       << ", \"redo_ms\": " << total.redo_seconds * 1000
+       << ", \"undo_ms\": " << total.undo_seconds * 1000
+       << "}" << (last ? "" : ",") << endl;
+  delete lm;
+}
+
+int runRecoverySweep(int argc, char *argv[]) {
+  SweepOptions opt;
+  bool parsed = parseOptions(argc, argv, 2, {"--full-restarts"},
+    [&](int argc, char *argv[], int& i) { return parseDriverOption(argc, argv, i, opt.driver); },
+    [&](const string& arg, const char* val) {
+      if (arg == "--full-restarts") opt.full_restarts = true;
+      else if (arg == "--pages") opt.pages = atoi(val);
+      else if (arg == "--sizes") opt.sizes = parseList(val);
+      else if (arg == "--checkpoint-every") opt.checkpoint_every = parseList(val);
+      else if (arg == "--points") opt.points = atoi(val);
+      else if (arg == "--sequences") opt.sequences = parseSequences(val);
+      else if (arg == "--concurrency") opt.concurrency = atoi(val);
+      else if (arg == "--seed") opt.seed = (unsigned)atoi(val);
+      else return false;
+      return true;
+    });
+  if (!parsed)
+    return 1;
+  if (opt.pages < 1 || opt.points < 1 || opt.concurrency < 1 || opt.sequences.empty()) {
+    cerr << "--pages, --points and --concurrency must be positive" << endl;
+    return 1;
+  }
+
+  // one spare line, as the engine cannot address the last page of a file
+  string db_filename = "output/dbs/sweep_in.db";
+  ofstream db(db_filename);
+  for (int i = 0; i <= opt.pages; ++i)
+    db << -1 << ' ' << string(32, 'x') << '\n';
+  db.close();
+
+  cout << "{" << endl << "  \"recovery_sweep\": [" << endl;
+  for (unsigned s = 0; s < opt.sizes.size(); ++s)
+    for (unsigned c = 0; c < opt.checkpoint_every.size(); ++c)
+      for (int p = 1; p <= opt.points; ++p)
+	for (unsigned q = 0; q < opt.sequences.size(); ++q) {
+	  bool last = s + 1 == opt.sizes.size() && c + 1 == opt.checkpoint_every.size()
+	    && p == opt.points && q + 1 == opt.sequences.size();
+	  runPoint(opt, db_filename, opt.sizes[s], opt.checkpoint_every[c],
+		   opt.sizes[s] * p / opt.points, opt.sequences[q], last);
+	}
+  cout << "  ]" << endl << "}" << endl;
+  remove(db_filename.c_str());
+  trace::finish();
+  return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef RECOVERYSWEEP_H_
+#define RECOVERYSWEEP_H_
+
+/*
+ * bench.o --recovery-sweep [options] [driver options]
+ *
+ * For every combination of log size (--sizes, updates), checkpoint
+ * spacing (--checkpoint-every, updates; 0 for none), crash point (--points
+ * evenly spread crash points up to each size) and crash sequence
+ * (--sequences, e.g. "7 3 2;2147483647" for crash {7 3 2} and one crash
+ * with no write limit), builds the log with a random update workload
+ * over --pages pages, crashes, and reports one JSON row: log records and
+ * dirty pages found by the first restart, and recovery time in total
+ * and per phase summed over the sequence. Each restart after the first
+ * resumes the one it interrupted, reusing the log records it parsed,
+ * unless --full-restarts is given.
+ */
+int runRecoverySweep(int argc, char *argv[]);
+
+#endif
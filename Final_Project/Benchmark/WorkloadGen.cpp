@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Workload generator for the testcase format.
+ *
+ * Writes a database file and a testcase script that runs against it:
+ * transactions interleaved at random, each doing some writes and then
+ * committing, aborting or being left open for the next crash, with
+ * checkpoints and (nested) crashes mixed in at the requested rates.
+ * The same options and seed always give the same files.
+ *
+ * usage: workloadgen.o --out testcases/genNN --db StorageEngine/genNN.db
+ *        [--pages n] [--page-size bytes] [--txns n] [--ops n]
+ *        [--write-min bytes] [--write-max bytes] [--concurrency n]
+ *        [--skew uniform|zipf|hotspot] [--zipf-theta t]
+ *        [--hot-fraction f] [--hot-prob p]
+ *        [--abort-ratio r] [--open-ratio r] [--abort-budget n]
+ *        [--checkpoint-every ops] [--crash-every ops] [--crash-depth n]
+ *        [--crash-writes n] [--seed s]
+ *
+ * The driver names the log after the last two characters of the testcase
+ * name, so --out testcases/gen07 logs to output/log/log07.log.
+ * Commits take whatever share of transactions is not aborted or left
+ * open; open transactions become losers at the next crash.
+ */
+
+struct Options {
+  string out;
+  string db;
+  int pages;
+  int page_size;
+  long txns;
+  long ops;
+  int write_min;
+  int write_max;
+  int concurrency;
+  string skew;
+  double zipf_theta;
+  double hot_fraction;
+  double hot_prob;
+  double abort_ratio;
+  double open_ratio;
+  long abort_budget;
+  long checkpoint_every;
+  long crash_every;
+  int crash_depth;
+  int crash_writes;
+  unsigned seed;
+
+  Options() {
+    pages = 1000;
+    page_size = 64;
+    txns = 10000;
+    ops = 100000;
+    write_min = 1;
+    write_max = 8;
+    concurrency = 8;
+    skew = "uniform";
+    zipf_theta = 0.99;
+    hot_fraction = 0.1;
+    hot_prob = 0.9;
+    abort_ratio = 0.05;
+    open_ratio = 0.0;
+    abort_budget = 1000000;
+    checkpoint_every = 0;
+    crash_every = 0;
+    crash_depth = 1;
+    crash_writes = 20;
+    seed = 484;
+  }
+};
+
+/*
+ * Picks page ids from 1 to pages with the configured skew. The ranking
+ * of pages by heat is a fixed random permutation, so hot pages are
+ * spread over the file rather than packed at its start.
+ */
+class PagePicker {
+ public:
+  PagePicker(const Options& opt, mt19937& rng) : rng(rng), coin(0.0, 1.0) {
+    skew = opt.skew;
+    hot_prob = opt.hot_prob;
+    order.resize(opt.pages);
+    for (int i = 0; i < opt.pages; ++i)
+      order[i] = i + 1;
+    shuffle(order.begin(), order.end(), rng);
+    hot = max(1, (int)(opt.pages * opt.hot_fraction));
+    if (skew == "zipf") {
+      cdf.resize(opt.pages);
+      double sum = 0;
+      for (int i = 0; i < opt.pages; ++i) {
+	sum += 1.0 / pow(i + 1, opt.zipf_theta);
+	cdf[i] = sum;
+      }
+      for (int i = 0; i < opt.pages; ++i)
+	cdf[i] /= sum;
+    }
+  }
+
+  int next() {
+    int rank;
+    if (skew == "zipf") {
+      rank = lower_bound(cdf.begin(), cdf.end(), coin(rng)) - cdf.begin();
+      rank = min(rank, (int)order.size() - 1);
+    } else if (skew == "hotspot") {
+      if (coin(rng) < hot_prob)
+	rank = uniform_int_distribution<int>(0, hot - 1)(rng);
+      else
+	rank = uniform_int_distribution<int>(0, (int)order.size() - 1)(rng);
+    } else {
+      rank = uniform_int_distribution<int>(0, (int)order.size() - 1)(rng);
+    }
+    return order[rank];
+  }
+
+ private:
+  mt19937& rng;
+  uniform_real_distribution<double> coin;
+  string skew;
+  double hot_prob;
+  int hot;
+  vector<int> order;
+  vector<double> cdf;
+};
+
+struct ActiveTx {
+  long txid;
+  long writes_left;
+};
+
+static bool parseArgs(int argc, char *argv[], Options& opt) {
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    if (i + 1 >= argc) {
+      cerr << "missing value for " << arg << endl;
+      return false;
+    }
+    string val = argv[++i];
+    if (arg == "--out") opt.out = val;
+    else if (arg == "--db") opt.db = val;
+    else if (arg == "--pages") opt.pages = atoi(val.c_str());
+    else if (arg == "--page-size") opt.page_size = atoi(val.c_str());
+    else if (arg == "--txns") opt.txns = atol(val.c_str());
+    else if (arg == "--ops") opt.ops = atol(val.c_str());
+    else if (arg == "--write-min") opt.write_min = atoi(val.c_str());
+    else if (arg == "--write-max") opt.write_max = atoi(val.c_str());
+    else if (arg == "--concurrency") opt.concurrency = atoi(val.c_str());
+    else if (arg == "--skew") opt.skew = val;
+    else if (arg == "--zipf-theta") opt.zipf_theta = atof(val.c_str());
+    else if (arg == "--hot-fraction") opt.hot_fraction = atof(val.c_str());
+    else if (arg == "--hot-prob") opt.hot_prob = atof(val.c_str());
+    else if (arg == "--abort-ratio") opt.abort_ratio = atof(val.c_str());
+    else if (arg == "--open-ratio") opt.open_ratio = atof(val.c_str());
+    else if (arg == "--abort-budget") opt.abort_budget = atol(val.c_str());
+    else if (arg == "--checkpoint-every") opt.checkpoint_every = atol(val.c_str());
+    else if (arg == "--crash-every") opt.crash_every = atol(val.c_str());
+    else if (arg == "--crash-depth") opt.crash_depth = atoi(val.c_str());
+    else if (arg == "--crash-writes") opt.crash_writes = atoi(val.c_str());
+    else if (arg == "--seed") opt.seed = (unsigned)atoi(val.c_str());
+    else {
+      cerr << "unknown option " << arg << endl;
+      return false;
+    }
+  }
+  if (opt.out.empty() || opt.db.empty()) {
+    cerr << "--out and --db are required" << endl;
+    return false;
+  }
+  if (opt.skew != "uniform" && opt.skew != "zipf" && opt.skew != "hotspot") {
+    cerr << "unknown skew " << opt.skew << endl;
+    return false;
+  }
+  opt.pages = max(opt.pages, 1);
+  opt.page_size = max(opt.page_size, 1);
+  opt.write_min = max(1, min(opt.write_min, opt.page_size));
+  opt.write_max = max(opt.write_min, min(opt.write_max, opt.page_size));
+  opt.concurrency = max(opt.concurrency, 1);
+  opt.txns = max(opt.txns, 1L);
+  opt.crash_depth = max(opt.crash_depth, 1);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  Options opt;
+  if (!parseArgs(argc, argv, opt))
+    return 1;
+  mt19937 rng(opt.seed);
+  uniform_real_distribution<double> coin(0.0, 1.0);
+
+  // The engine cannot address the last line of a database file, so write
+  // one spare page past the ones the script uses.
+  ofstream db(opt.db);
+  string blank(opt.page_size, 'x');
+  for (int i = 0; i <= opt.pages; ++i)
+    db << -1 << ' ' << blank << '\n';
+  db.close();
+
+  ofstream script(opt.out);
+  script << opt.db << '\n';
+
+  PagePicker picker(opt, rng);
+  uniform_int_distribution<int> write_len(opt.write_min, opt.write_max);
+  uniform_int_distribution<int> letter(0, 25);
+  // spread the writes over the transactions, at least one each
+  long mean_writes = max(1L, opt.ops / opt.txns);
+  uniform_int_distribution<long> tx_writes(1, 2 * mean_writes - 1);
+  uniform_int_distribution<int> crash_writes(0, max(opt.crash_writes, 0));
+  uniform_int_distribution<int> crash_depth(1, opt.crash_depth);
+
+  vector<ActiveTx> active;
+  long next_txid = 1;
+  long started = 0;
+  long ops = 0;
+  long lines = 0;
+  while (ops < opt.ops && (started < opt.txns || !active.empty())) {
+    while ((int)active.size() < opt.concurrency && started < opt.txns) {
+      ActiveTx tx;
+      tx.txid = next_txid++;
+      tx.writes_left = tx_writes(rng);
+      active.push_back(tx);
+      ++started;
+    }
+    if (active.empty())
+      break;
+
+    unsigned pick = uniform_int_distribution<unsigned>(0, active.size() - 1)(rng);
+    ActiveTx& tx = active[pick];
+    if (tx.writes_left > 0) {
+      int len = write_len(rng);
+      int offset = uniform_int_distribution<int>(0, opt.page_size - len)(rng);
+      string text(len, 'a');
+      for (int i = 0; i < len; ++i)
+	text[i] = 'a' + letter(rng);
+      script << tx.txid << " write " << picker.next() << ' ' << offset << ' ' << text << '\n';
+      --tx.writes_left;
+      ++ops;
+      ++lines;
+    } else {
+      double end = coin(rng);
+      if (end < opt.abort_ratio) {
+	script << tx.txid << " abort " << opt.abort_budget << '\n';
+	++lines;
+      } else if (end >= opt.abort_ratio + opt.open_ratio) {
+	script << tx.txid << " commit" << '\n';
+	++lines;
+      }
+      // an open transaction just stops; the next crash makes it a loser
+      active[pick] = active.back();
+      active.pop_back();
+      continue;
+    }
+
+    if (opt.checkpoint_every > 0 && ops % opt.checkpoint_every == 0) {
+      script << "checkpoint" << '\n';
+      ++lines;
+    }
+    if (opt.crash_every > 0 && ops % opt.crash_every == 0) {
+      script << "crash {";
+      int depth = crash_depth(rng);
+      for (int i = 0; i < depth; ++i)
+	script << (i ? " " : "") << crash_writes(rng);
+      script << "}" << '\n';
+      ++lines;
+      // everything in flight is rolled back by the restart
+      active.clear();
+    }
+  }
+  script << "end" << '\n';
+  script.close();
+
+  cerr << "wrote " << opt.out << ": " << lines << " lines, " << ops << " writes, "
+       << started << " transactions; " << opt.db << ": " << opt.pages << " pages" << endl;
+  return 0;
+}
@@ -0,0 +1,350 @@
+#include "AsyncIO.h"
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+using namespace std;
+
+enum AsyncOp {ASYNC_READ, ASYNC_WRITE, ASYNC_SYNC};
+
+///////////////////  ThreadPoolIO  ///////////////////
+
+/*
+ * Runs queued I/O on a few worker threads. A sync waits at the head of
+ * the queue until every I/O started before it has finished.
+ */
+class ThreadPoolIO : public AsyncIO {
+ public:
+  explicit ThreadPoolIO(unsigned thread_count) {
+    running = 0;
+    stopping = false;
+    failed = false;
+    for (unsigned i = 0; i < thread_count; ++i)
+      workers.push_back(thread(&ThreadPoolIO::work, this));
+  }
+
+  ~ThreadPoolIO() {
+    {
+      lock_guard<mutex> guard(lock);
+      stopping = true;
+    }
+    ready.notify_all();
+    for (unsigned i = 0; i < workers.size(); ++i)
+      workers[i].join();
+  }
+
+  void pread(int fd, void* buf, size_t len, off_t offset) {
+    push(Job(ASYNC_READ, fd, (char*)buf, len, offset));
+  }
+
+  void pwrite(int fd, const void* buf, size_t len, off_t offset) {
+    push(Job(ASYNC_WRITE, fd, (char*)buf, len, offset));
+  }
+
+  void fdatasync(int fd) {
+    push(Job(ASYNC_SYNC, fd, NULL, 0, 0));
+  }
+
+  bool drain() {
+    unique_lock<mutex> guard(lock);
+    done.wait(guard, [this] { return jobs.empty() && running == 0; });
+    bool ok = !failed;
+    failed = false;
+    return ok;
+  }
+
+  const char* name() const { return "threads"; }
+
+ private:
+  struct Job {
+    AsyncOp op;
+    int fd;
+    char* buf;
+    size_t len;
+    off_t offset;
+
+    Job(AsyncOp new_op, int new_fd, char* new_buf, size_t new_len, off_t new_offset) {
+      op = new_op;
+      fd = new_fd;
+      buf = new_buf;
+      len = new_len;
+      offset = new_offset;
+    }
+  };
+
+  mutex lock;
+  condition_variable ready;
+  condition_variable done;
+  deque<Job> jobs;
+  vector<thread> workers;
+  unsigned running;
+  bool stopping;
+  bool failed;
+
+  void push(const Job& job) {
+    {
+      lock_guard<mutex> guard(lock);
+      jobs.push_back(job);
+    }
+    ready.notify_one();
+  }
+
+  bool runnable() {
+    return !jobs.empty() && (jobs.front().op != ASYNC_SYNC || running == 0);
+  }
+
+  static bool perform(const Job& job) {
+    if (job.op == ASYNC_SYNC)
+      return ::fdatasync(job.fd) == 0;
+    size_t done_bytes = 0;
+    while (done_bytes < job.len) {
+      ssize_t n = job.op == ASYNC_READ
+        ? ::pread(job.fd, job.buf + done_bytes, job.len - done_bytes, job.offset + done_bytes)
+        : ::pwrite(job.fd, job.buf + done_bytes, job.len - done_bytes, job.offset + done_bytes);
+      if (n <= 0)
+        return false;
+      done_bytes += n;
+    }
+    return true;
+  }
+
+  void work() {
+    unique_lock<mutex> guard(lock);
+    while (true) {
+      ready.wait(guard, [this] { return stopping || runnable(); });
+      if (stopping && jobs.empty())
+        return;
+      if (!runnable())
+        continue;
+      Job job = jobs.front();
+      jobs.pop_front();
+      ++running;
+      guard.unlock();
+      bool ok = perform(job);
+      guard.lock();
+      --running;
+      if (!ok)
+        failed = true;
+      // a sync may be waiting on this one, and drain on all of them
+      ready.notify_all();
+      done.notify_all();
+    }
+  }
+};
+
+///////////////////  End ThreadPoolIO  ///////////////////
+
+#ifdef HAVE_IO_URING
+
+///////////////////  UringIO  ///////////////////
+
+/*
+ * io_uring through the raw system calls, so no liburing is needed. I/O
+ * is queued in the submission ring and handed to the kernel by drain(),
+ * or earlier when the ring fills up.
+ */
+class UringIO : public AsyncIO {
+ public:
+  UringIO() {
+    ring_fd = -1;
+    sq_ptr = cq_ptr = MAP_FAILED;
+    sqes = (io_uring_sqe*)MAP_FAILED;
+    queued = 0;
+    in_flight = 0;
+    failed = false;
+  }
+
+  ~UringIO() {
+    if (ring_fd >= 0)
+      drain();
+    if (sqes != MAP_FAILED)
+      munmap(sqes, sqes_len);
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+      munmap(cq_ptr, cq_len);
+    if (sq_ptr != MAP_FAILED)
+      munmap(sq_ptr, sq_len);
+    if (ring_fd >= 0)
+      close(ring_fd);
+  }
+
+  bool init(unsigned queue_depth) {
+    io_uring_params p = io_uring_params();
+    ring_fd = (int)syscall(__NR_io_uring_setup, queue_depth, &p);
+    if (ring_fd < 0)
+      return false;
+    entries = p.sq_entries;
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && cq_len > sq_len)
+      sq_len = cq_len;
+    sq_ptr = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+      return false;
+    cq_ptr = single ? sq_ptr
+      : mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+             ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED)
+      return false;
+    sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+    sqes = (io_uring_sqe*)mmap(NULL, sqes_len, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+      return false;
+
+    char* sq = (char*)sq_ptr;
+    char* cq = (char*)cq_ptr;
+    sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+    sq_array = (unsigned*)(sq + p.sq_off.array);
+    cq_head = (unsigned*)(cq + p.cq_off.head);
+    cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+    cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    return true;
+  }
+
+  void pread(int fd, void* buf, size_t len, off_t offset) {
+    queue(IORING_OP_READ, fd, buf, len, offset);
+  }
+
+  void pwrite(int fd, const void* buf, size_t len, off_t offset) {
+    queue(IORING_OP_WRITE, fd, buf, len, offset);
+  }
+
+  void fdatasync(int fd) {
+    io_uring_sqe* sqe = queue(IORING_OP_FSYNC, fd, NULL, 0, 0);
+    sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    sqe->flags |= IOSQE_IO_DRAIN;
+  }
+
+  bool drain() {
+    while (queued > 0 || in_flight > 0)
+      submitAndWait();
+    bool ok = !failed;
+    failed = false;
+    return ok;
+  }
+
+  const char* name() const { return "io_uring"; }
+
+ private:
+  int ring_fd;
+  unsigned entries;
+  void* sq_ptr;
+  void* cq_ptr;
+  size_t sq_len, cq_len, sqes_len;
+  unsigned* sq_tail;
+  unsigned sq_mask;
+  unsigned* sq_array;
+  unsigned* cq_head;
+  unsigned* cq_tail;
+  unsigned cq_mask;
+  io_uring_sqe* sqes;
+  io_uring_cqe* cqes;
+  unsigned queued;     // in the ring, not yet submitted
+  unsigned in_flight;  // submitted, not yet reaped
+  bool failed;
+
+  io_uring_sqe* queue(int op, int fd, const void* buf, size_t len, off_t offset) {
+    // a full ring, or more I/O out than completions can be held for
+    if (queued + in_flight >= entries)
+      submitAndWait();
+    unsigned tail = *sq_tail;
+    unsigned index = tail & sq_mask;
+    io_uring_sqe* sqe = &sqes[index];
+    *sqe = io_uring_sqe();
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    // the result that means success; a slot can be reused before its
+    // I/O completes, so it cannot key a table
+    sqe->user_data = len;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++queued;
+    return sqe;
+  }
+
+  /*
+   * Submits what is queued and waits for at least one completion. If
+   * the kernel refuses the submission, the queued I/O is taken back out
+   * of the ring and fails, and this waits until everything already in
+   * flight has completed, as the kernel may still be reading or writing
+   * those buffers.
+   */
+  void submitAndWait() {
+    if (enter(queued, 1)) {
+      reap();
+      return;
+    }
+    failed = true;
+    __atomic_store_n(sq_tail, *sq_tail - queued, __ATOMIC_RELEASE);
+    queued = 0;
+    while (in_flight > 0) {
+      if (!enter(0, 1))
+        usleep(100); // completions still land in the mapped ring
+      reap();
+    }
+  }
+
+  // io_uring_enter, retried while it is interrupted or short of memory.
+  bool enter(unsigned to_submit, unsigned min_complete) {
+    int n;
+    do {
+      n = (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                       min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+      if (n < 0 && errno == EBUSY) // the completion ring is full
+        reap();
+    } while (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+    if (n < 0)
+      return false;
+    queued -= n;
+    in_flight += n;
+    return true;
+  }
+
+  void reap() {
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      io_uring_cqe* cqe = &cqes[head & cq_mask];
+      if (cqe->res < 0 || (size_t)cqe->res != cqe->user_data)
+        failed = true;
+      --in_flight;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+};
+
+///////////////////  End UringIO  ///////////////////
+
+#endif
+
+AsyncIO* AsyncIO::create(bool use_uring, unsigned queue_depth) {
+#ifdef HAVE_IO_URING
+  if (use_uring) {
+    UringIO* uring = new UringIO();
+    if (uring->init(queue_depth))
+      return uring;
+    delete uring;
+  }
+#endif
+  return new ThreadPoolIO(4);
+}
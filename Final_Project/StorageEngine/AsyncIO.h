@@ -0,0 +1,44 @@
+#ifndef ASYNCIO_H_
+#define ASYNCIO_H_
+
+#include <cstddef>
+#include <sys/types.h>
+
+/*
+ * Queue of file I/O that runs in the background, so one thread can have
+ * many writes in flight and wait for them together.
+ *
+ * On Linux the io_uring backend submits through the kernel's rings; where
+ * io_uring is missing or refused, a small thread pool runs plain
+ * pread/pwrite/fdatasync calls instead. Buffers handed in must stay
+ * valid and unchanged until drain() returns.
+ */
+class AsyncIO {
+ public:
+  virtual ~AsyncIO() {}
+
+  virtual void pread(int fd, void* buf, size_t len, off_t offset) = 0;
+  virtual void pwrite(int fd, const void* buf, size_t len, off_t offset) = 0;
+
+  /*
+   * Queues an fdatasync of fd that starts only after everything queued
+   * before it has completed.
+   */
+  virtual void fdatasync(int fd) = 0;
+
+  /*
+   * Submits everything queued and waits until it has completed. Returns
+   * false if any of it failed or was short.
+   */
+  virtual bool drain() = 0;
+
+  virtual const char* name() const = 0;
+
+  /*
+   * An io_uring backend with queue_depth entries if use_uring and the
+   * kernel allows it, else a thread pool backend.
+   */
+  static AsyncIO* create(bool use_uring, unsigned queue_depth);
+};
+
+#endif
@@ -0,0 +1,316 @@
+#include "CoDriver.h"
+#include "StorageEngine.h"
+#include "Testcase.h"
+#include "Trace.h"
+#include "../StudentComponent/LogMgr.h"
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+// Pages a batch of page misses may hold pinned while their transactions
+// run, leaving the rest of the buffer pool for everyone else.
+const unsigned PAGE_BATCH = 4;
+
+// A transaction's coroutine. It starts suspended.
+struct TxTask {
+  struct promise_type {
+    TxTask get_return_object() {
+      return TxTask(coroutine_handle<promise_type>::from_promise(*this));
+    }
+    suspend_always initial_suspend() noexcept { return {}; }
+    suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { terminate(); }
+  };
+
+  coroutine_handle<promise_type> handle;
+
+  TxTask() {}
+  explicit TxTask(coroutine_handle<promise_type> h) : handle(h) {}
+  TxTask(TxTask&& other) noexcept : handle(exchange(other.handle, nullptr)) {}
+  TxTask& operator=(TxTask&& other) noexcept {
+    if (handle)
+      handle.destroy();
+    handle = exchange(other.handle, nullptr);
+    return *this;
+  }
+  ~TxTask() {
+    if (handle)
+      handle.destroy();
+  }
+};
+
+enum TxWait {TX_RUNNING, TX_WAIT_OP, TX_WAIT_PAGE, TX_WAIT_DURABLE};
+
+struct Tx {
+  int txid;
+  deque<TestcaseOp> inbox; // its testcase lines not yet run
+  TxWait wait;
+  int page_id;             // while TX_WAIT_PAGE
+  int commit_lsn;          // while TX_WAIT_DURABLE
+  TxTask task;
+};
+
+class Scheduler {
+ public:
+  Scheduler(StorageEngine& new_se, LogMgr* new_lm, unsigned new_group_size)
+    : se(new_se), lm(new_lm), group_size(new_group_size) {}
+
+  void setLogMgr(LogMgr* new_lm) { lm = new_lm; }
+
+  /*
+   * Hands a write, commit or abort line to its transaction, starting a
+   * coroutine for it if it has none.
+   */
+  void dispatch(const TestcaseOp& op) {
+    // keep the testcase's order of writes to one page, and of rollbacks
+    if (conflictsWithWaiters(op))
+      resolvePages();
+    Tx* tx = find(op.txid);
+    if (tx && tx->wait == TX_WAIT_DURABLE) { //the txid is being reused
+      flushCommits();
+      tx = find(op.txid);
+    }
+    if (!tx)
+      tx = start(op.txid);
+    tx->inbox.push_back(op);
+    if (tx->wait == TX_WAIT_OP)
+      resume(tx);
+    if (commit_waiters.size() >= group_size)
+      flushCommits();
+    if (page_waiters.size() >= PAGE_BATCH)
+      resolvePages();
+  }
+
+  /*
+   * Runs every transaction until it waits for its next line: loads the
+   * pages they wait on and makes the waiting commits durable.
+   */
+  void barrier() {
+    while (!page_waiters.empty() || !commit_waiters.empty()) {
+      resolvePages();
+      flushCommits();
+    }
+  }
+
+ private:
+  StorageEngine& se;
+  LogMgr* lm;
+  unsigned group_size;
+  map<int, unique_ptr<Tx> > txs;
+  deque<Tx*> page_waiters;
+  deque<Tx*> commit_waiters;
+
+  struct NextOp {
+    Tx& tx;
+    bool await_ready() { return !tx.inbox.empty(); }
+    void await_suspend(coroutine_handle<>) { tx.wait = TX_WAIT_OP; }
+    TestcaseOp await_resume() {
+      tx.wait = TX_RUNNING;
+      TestcaseOp op = tx.inbox.front();
+      tx.inbox.pop_front();
+      return op;
+    }
+  };
+
+  struct PageReady {
+    Scheduler& s;
+    Tx& tx;
+    int page_id;
+    bool await_ready() { return s.se.isBuffered(page_id); }
+    void await_suspend(coroutine_handle<>) {
+      tx.wait = TX_WAIT_PAGE;
+      tx.page_id = page_id;
+      s.page_waiters.push_back(&tx);
+    }
+    void await_resume() { tx.wait = TX_RUNNING; }
+  };
+
+  struct Durable {
+    Scheduler& s;
+    Tx& tx;
+    int lsn;
+    bool await_ready() { return false; }
+    void await_suspend(coroutine_handle<>) {
+      tx.wait = TX_WAIT_DURABLE;
+      tx.commit_lsn = lsn;
+      s.commit_waiters.push_back(&tx);
+    }
+    void await_resume() { tx.wait = TX_RUNNING; }
+  };
+
+  TxTask transaction(Tx& tx) {
+    while (true) {
+      TestcaseOp op = co_await NextOp{tx};
+      if (op.type == OP_WRITE) {
+        co_await PageReady{*this, tx, op.page_id};
+        se.write(op.txid, op.page_id, op.offset, op.text);
+      }
+      else if (op.type == OP_COMMIT) {
+        if (se.asyncCommit()) { //nothing to wait for
+          lm->commitAsync(op.txid);
+          co_return;
+        }
+        int lsn = lm->commitRecord(op.txid);
+        if (lsn == NULL_LSN) //txid refused
+          co_return;
+        co_await Durable{*this, tx, lsn};
+        lm->endCommit(op.txid, lsn);
+        co_return;
+      }
+      else if (op.type == OP_ABORT) {
+        se.abort(op.txid, op.pages_allowed);
+        co_return;
+      }
+    }
+  }
+
+  Tx* find(int txid) {
+    auto it = txs.find(txid);
+    return it == txs.end() ? nullptr : it->second.get();
+  }
+
+  Tx* start(int txid) {
+    unique_ptr<Tx> tx(new Tx());
+    tx->txid = txid;
+    tx->wait = TX_RUNNING;
+    tx->task = transaction(*tx);
+    Tx* raw = tx.get();
+    txs[txid] = move(tx);
+    raw->task.handle.resume(); //runs to its first NextOp
+    return raw;
+  }
+
+  // Runs tx until it suspends, and forgets it once it has finished.
+  void resume(Tx* tx) {
+    tx->task.handle.resume();
+    if (tx->task.handle.done())
+      txs.erase(tx->txid);
+  }
+
+  /*
+   * Whether op could see a different page than in testcase order if it
+   * ran ahead of the transactions waiting on pages: it writes a page one
+   * of them will write, or one of them will roll back, or it rolls back.
+   */
+  bool conflictsWithWaiters(const TestcaseOp& op) {
+    if (page_waiters.empty() || op.type == OP_COMMIT)
+      return false;
+    if (op.type == OP_ABORT)
+      return true;
+    for (unsigned i = 0; i < page_waiters.size(); ++i) {
+      const Tx* tx = page_waiters[i];
+      if (tx->page_id == op.page_id)
+        return true;
+      for (unsigned j = 0; j < tx->inbox.size(); ++j) {
+        if (tx->inbox[j].type == OP_ABORT
+            || (tx->inbox[j].type == OP_WRITE && tx->inbox[j].page_id == op.page_id))
+          return true;
+      }
+    }
+    return false;
+  }
+
+  /*
+   * Loads the pages of up to PAGE_BATCH waiting transactions with one
+   * pinPages, which has their reads in flight together, then runs each
+   * in turn; repeats until none waits on a page.
+   */
+  void resolvePages() {
+    while (!page_waiters.empty()) {
+      vector<int> pages;
+      for (unsigned i = 0; i < page_waiters.size() && pages.size() < PAGE_BATCH; ++i)
+        pages.push_back(page_waiters[i]->page_id);
+      unsigned pinned = se.pinPages(pages);
+      //with no frame left even for the first, it runs and finds none
+      vector<Tx*> batch;
+      while (batch.empty() || batch.size() < pinned) {
+        batch.push_back(page_waiters.front());
+        page_waiters.pop_front();
+      }
+      for (unsigned i = 0; i < batch.size(); ++i)
+        resume(batch[i]);
+      for (unsigned i = 0; i < pinned; ++i)
+        se.unpinPage(pages[i]);
+    }
+  }
+
+  /*
+   * Makes every waiting commit durable with one log flush, then lets the
+   * transactions finish.
+   */
+  void flushCommits() {
+    if (commit_waiters.empty())
+      return;
+    TraceScope scope("group_commit");
+    scope.arg("commits", commit_waiters.size());
+    int lsn = NULL_LSN;
+    for (unsigned i = 0; i < commit_waiters.size(); ++i)
+      lsn = max(lsn, commit_waiters[i]->commit_lsn);
+    lm->forceLog(lsn);
+    deque<Tx*> durable;
+    durable.swap(commit_waiters);
+    for (unsigned i = 0; i < durable.size(); ++i)
+      resume(durable[i]);
+  }
+};
+
+}
+
+void runTestcaseCoroutines(const string& filename, const DriverOptions& options) {
+  StorageEngine se;
+  applyDriverOptions(options, se);
+  LogMgr* lm = new LogMgr();
+  lm->setStorageEngine(&se);
+  ifstream myfile(filename);
+  string db_filename;
+  getline(myfile, db_filename);
+  se.start(db_filename, lm, filename.substr(filename.length() - 2));
+
+  Scheduler scheduler(se, lm, options.group_commit);
+  string contents;
+  getline(myfile, contents);
+  while (contents != "") {
+    TestcaseOp op = parseTestcaseLine(contents);
+    if (op.type == OP_WRITE || op.type == OP_COMMIT || op.type == OP_ABORT) {
+      scheduler.dispatch(op);
+    }
+    else if (op.type == OP_CRASH) {
+      scheduler.barrier();
+      lm = crash(op.safe_writes, &se);
+      se.end_crash(lm);
+      scheduler.setLogMgr(lm);
+    }
+    else if (op.type == OP_CHECKPOINT) {
+      scheduler.barrier();
+      lm->checkpoint();
+    }
+    else if (op.type == OP_DAMAGE) {
+      scheduler.barrier();
+      if (!se.damagePage(op.page_id))
+        cerr << "page " << op.page_id << " is not in the buffer to damage" << endl;
+    }
+    else if (op.type == OP_REPAIR) {
+      scheduler.barrier();
+      if (!se.repairPage(op.page_id))
+        cerr << "could not repair page " << op.page_id << endl;
+    }
+    else if (op.type == OP_END) {
+      scheduler.barrier();
+      se.end(se.getOutputFileName());
+      break;
+    }
+    getline(myfile, contents);
+  }
+  scheduler.barrier();
+  delete lm;
+}
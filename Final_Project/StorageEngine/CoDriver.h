@@ -0,0 +1,24 @@
+#ifndef CODRIVER_H_
+#define CODRIVER_H_
+
+#include <string>
+
+struct DriverOptions;
+
+/*
+ * Runs a testcase with each transaction as a C++20 coroutine (main.o
+ * --coroutines). A transaction suspends when its next write needs a page
+ * that is not buffered and when it waits for its commit to be durable;
+ * one thread keeps every other transaction going meanwhile. The pages
+ * waited on are loaded a few at a time with one pinPages, so with async
+ * I/O and a page file their reads are in flight together. Waiting
+ * commits are made durable together by a single log flush once
+ * options.group_commit of them have gathered, or at a checkpoint, crash
+ * or end line.
+ *
+ * Commit and end records land in a different order than with the plain
+ * driver, so the log and page LSNs differ; the data does not.
+ */
+void runTestcaseCoroutines(const std::string& filename, const DriverOptions& options);
+
+#endif
@@ -0,0 +1,154 @@
+#include "LogCodec.h"
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+static const unsigned MIN_MATCH = 4;
+static const unsigned HASH_BITS = 12;
+
+static unsigned hash4(const char* p) {
+  unsigned v;
+  memcpy(&v, p, 4);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+//Writes the 15 + 255 + 255 + ... continuation bytes of a long length.
+static void putLength(unsigned len, string& out) {
+  while (len >= 255) {
+    out += (char)255;
+    len -= 255;
+  }
+  out += (char)len;
+}
+
+static void putSequence(const char* lit, unsigned lit_len, unsigned offset,
+			unsigned match_len, string& out) {
+  unsigned lit_code = lit_len < 15 ? lit_len : 15;
+  unsigned match_code = 0;
+  if (match_len > 0)
+    match_code = match_len - MIN_MATCH < 15 ? match_len - MIN_MATCH : 15;
+  out += (char)((lit_code << 4) | match_code);
+  if (lit_code == 15)
+    putLength(lit_len - 15, out);
+  out.append(lit, lit_len);
+  if (match_len == 0) //last sequence has no match
+    return;
+  out += (char)(offset & 0xff);
+  out += (char)(offset >> 8);
+  if (match_code == 15)
+    putLength(match_len - MIN_MATCH - 15, out);
+}
+
+LogCompressor::LogCompressor() : table(1 << HASH_BITS, -1) {}
+
+void LogCompressor::insert(unsigned pos) {
+  table[hash4(window.data() + pos)] = pos;
+}
+
+/*
+ * Drops all but the last LOG_CODEC_WINDOW bytes of the window and shifts
+ * the table to match, so the window stays bounded without rehashing.
+ */
+void LogCompressor::slide() {
+  unsigned shift = window.length() - LOG_CODEC_WINDOW;
+  window.erase(0, shift);
+  for (unsigned i = 0; i < table.size(); ++i)
+    table[i] = table[i] >= (int)shift ? table[i] - shift : -1;
+}
+
+void LogCompressor::reset(const string& history) {
+  unsigned keep = history.length() < LOG_CODEC_WINDOW ? history.length() : LOG_CODEC_WINDOW;
+  window = history.substr(history.length() - keep);
+  table.assign(table.size(), -1);
+  for (unsigned i = 0; i + MIN_MATCH <= window.length(); ++i)
+    insert(i);
+}
+
+void LogCompressor::compress(const string& raw, string& out) {
+  out.clear();
+  unsigned anchor = window.length();
+  //the last few bytes of history could not be hashed until now
+  unsigned i = anchor >= MIN_MATCH ? anchor - MIN_MATCH + 1 : 0;
+  window += raw;
+  for (; i < anchor && i + MIN_MATCH <= window.length(); ++i)
+    insert(i);
+  i = anchor;
+
+  const char* base = window.data();
+  unsigned end = window.length();
+  while (i + MIN_MATCH <= end) {
+    unsigned h = hash4(base + i);
+    int cand = table[h];
+    table[h] = i;
+    if (cand < 0 || i - cand > LOG_CODEC_WINDOW 
+	|| memcmp(base + cand, base + i, MIN_MATCH) != 0) {
+      ++i;
+      continue;
+    }
+    unsigned len = MIN_MATCH;
+    while (i + len < end && base[cand + len] == base[i + len])
+      ++len;
+    putSequence(base + anchor, i - anchor, i - cand, len, out);
+    for (unsigned j = i + 1; j < i + len && j + MIN_MATCH <= end; ++j)
+      insert(j);
+    i += len;
+    anchor = i;
+  }
+  putSequence(base + anchor, end - anchor, 0, 0, out);
+
+  if (window.length() > 2 * LOG_CODEC_WINDOW)
+    slide();
+}
+
+//Reads a continued length; returns false on running off the block.
+static bool getLength(const unsigned char*& p, const unsigned char* end, 
+		      unsigned& len) {
+  unsigned char b;
+  do {
+    if (p >= end)
+      return false;
+    b = *p++;
+    len += b;
+  } while (b == 255);
+  return true;
+}
+
+bool decompressLogBlock(const char* src, unsigned len, unsigned raw_len, 
+			string& out) {
+  const unsigned char* p = (const unsigned char*)src;
+  const unsigned char* end = p + len;
+  size_t o = out.length();
+  size_t target = o + raw_len;
+  out.resize(target);
+  char* dst = &out[0];
+  while (p < end) {
+    unsigned token = *p++;
+    unsigned lit_len = token >> 4;
+    if (lit_len == 15 && !getLength(p, end, lit_len))
+      return false;
+    if (lit_len > (unsigned)(end - p) || lit_len > target - o)
+      return false;
+    memcpy(dst + o, p, lit_len);
+    o += lit_len;
+    p += lit_len;
+    if (p == end) //last sequence
+      break;
+    if (end - p < 2)
+      return false;
+    unsigned offset = p[0] | (p[1] << 8);
+    p += 2;
+    unsigned match_len = token & 15;
+    if (match_len == 15 && !getLength(p, end, match_len))
+      return false;
+    match_len += MIN_MATCH;
+    if (offset == 0 || offset > o || match_len > target - o)
+      return false;
+    //byte by byte, since a match may overlap the bytes it produces
+    const char* from = dst + o - offset;
+    for (unsigned k = 0; k < match_len; ++k)
+      dst[o + k] = from[k];
+    o += match_len;
+  }
+  return o == target;
+}
@@ -0,0 +1,53 @@
+#ifndef LOGCODEC_H_
+#define LOGCODEC_H_
+
+#include <string>
+#include <vector>
+
+/*
+ * A small LZ77 codec for log blocks, in the spirit of LZ4: a block is a
+ * list of sequences, each a run of literals followed by a copy of at
+ * least 4 bytes from up to 64KiB back.
+ *
+ * Log blocks are short (often one commit), so a block may copy from the
+ * raw log that came before it. The compressor keeps that history between
+ * blocks, and blocks are decompressed in order onto the end of the text
+ * decoded so far.
+ */
+
+// How much earlier log a block may refer back into.
+const unsigned LOG_CODEC_WINDOW = 65535;
+
+class LogCompressor {
+ public:
+  LogCompressor();
+
+  /*
+   * Compresses raw into out (replacing its contents), then adds raw to
+   * the history later blocks may refer back to.
+   */
+  void compress(const std::string& raw, std::string& out);
+
+  /*
+   * Forgets the history and starts again from the given log text, e.g.
+   * the log read back after a crash.
+   */
+  void reset(const std::string& history);
+
+ private:
+  std::string window; //recent raw log, oldest first
+  std::vector<int> table; //hash of 4 bytes -> last position in window
+
+  void insert(unsigned pos);
+  void slide();
+};
+
+/*
+ * Decodes the len bytes at src and appends raw_len bytes to out, which
+ * must end with the history the block was compressed against.
+ * Returns false if the block is malformed.
+ */
+bool decompressLogBlock(const char* src, unsigned len, unsigned raw_len, 
+			std::string& out);
+
+#endif
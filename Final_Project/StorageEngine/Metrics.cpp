@@ -0,0 +1,120 @@
+#include "Metrics.h"
+
+#ifdef DB_METRICS
+
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace metrics {
+
+static const char* NAMES[METRIC_COUNT] = {
+  "page_hits",
+  "page_misses",
+  "evictions",
+  "dirty_flushes",
+  "wal_forces",
+  "log_bytes_written",
+  "records_parsed",
+  "bytes_parsed",
+  "redo_applied",
+  "redo_skipped",
+  "clrs_written",
+  "control_flushes",
+  "redo_bytes_est",
+  "recovery_us_est",
+};
+
+/*
+ * Blocks of the live threads, and the totals of those that have exited.
+ * Leaked on purpose, so threads exiting during static destruction can
+ * still hand their counts in.
+ */
+struct Registry {
+  mutex lock;
+  vector<Block*> blocks;
+  unsigned long retired[METRIC_COUNT];
+
+  Registry() {
+    for (int i = 0; i < METRIC_COUNT; ++i)
+      retired[i] = 0;
+  }
+};
+
+static Registry& registry() {
+  static Registry* r = new Registry();
+  return *r;
+}
+
+// Owns the calling thread's block and retires it when the thread exits.
+struct ThreadBlock {
+  Block block;
+
+  ThreadBlock() {
+    for (int i = 0; i < METRIC_COUNT; ++i)
+      block.counts[i].store(0, memory_order_relaxed);
+    Registry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    r.blocks.push_back(&block);
+  }
+
+  ~ThreadBlock() {
+    Registry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    for (int i = 0; i < METRIC_COUNT; ++i)
+      r.retired[i] += block.counts[i].load(memory_order_relaxed);
+    for (unsigned i = 0; i < r.blocks.size(); ++i) {
+      if (r.blocks[i] == &block) {
+	r.blocks.erase(r.blocks.begin() + i);
+	break;
+      }
+    }
+    local_block = NULL;
+  }
+};
+
+thread_local Block* local_block = NULL;
+
+Block* registerThread() {
+  static thread_local ThreadBlock owned;
+  local_block = &owned.block;
+  return local_block;
+}
+
+const char* name(MetricId id) {
+  return NAMES[id];
+}
+
+unsigned long read(MetricId id) {
+  Registry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+  unsigned long total = r.retired[id];
+  for (unsigned i = 0; i < r.blocks.size(); ++i)
+    total += r.blocks[i]->counts[id].load(memory_order_relaxed);
+  return total;
+}
+
+/*
+ * Zeroes every counter. Counts a thread adds while this runs may be
+ * lost, so call it when the engine is quiet.
+ */
+void reset() {
+  Registry& r = registry();
+  lock_guard<mutex> guard(r.lock);
+  for (int i = 0; i < METRIC_COUNT; ++i) {
+    r.retired[i] = 0;
+    for (unsigned j = 0; j < r.blocks.size(); ++j)
+      r.blocks[j]->counts[i].store(0, memory_order_relaxed);
+  }
+}
+
+void dump(ostream& out) {
+  for (int i = 0; i < METRIC_COUNT; ++i)
+    out << NAMES[i] << ' ' << read((MetricId)i) << '\n';
+  out.flush();
+}
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+/*
+ * Event counters for the hot paths of StorageEngine and LogMgr.
+ *
+ * Each thread bumps its own block of counters, so counting never takes
+ * a lock or shares a cache line; readers add up the blocks of every
+ * thread, live or exited. Build with -DDB_METRICS (make metrics) to turn
+ * them on. Otherwise the METRIC_* macros expand to nothing and none of
+ * this is compiled in.
+ */
+
+enum MetricId {
+  METRIC_PAGE_HITS,        // findPage found the page in the buffer
+  METRIC_PAGE_MISSES,      // findPage had to load it
+  METRIC_EVICTIONS,        // a frame was emptied to make room
+  METRIC_DIRTY_FLUSHES,    // a dirty page was written back
+  METRIC_WAL_FORCES,       // pageFlushed forced the log ahead of a page
+  METRIC_LOG_BYTES_WRITTEN,// bytes handed to updateLog
+  METRIC_RECORDS_PARSED,   // log records read by stringToLRVector
+  METRIC_BYTES_PARSED,     // log bytes read by stringToLRVector
+  METRIC_REDO_APPLIED,     // updates and CLRs redo wrote to a page
+  METRIC_REDO_SKIPPED,     // updates and CLRs redo found already on the page
+  METRIC_CLRS_WRITTEN,     // CLRs appended by undo
+  METRIC_CONTROL_FLUSHES,  // dirty pages the flush controller wrote back
+  METRIC_REDO_BYTES_EST,   // log bytes a restart now would redo (gauge)
+  METRIC_RECOVERY_US_EST,  // and the microseconds it would take (gauge)
+  METRIC_COUNT
+};
+
+#ifdef DB_METRICS
+
+#include <atomic>
+#include <ostream>
+
+namespace metrics {
+
+// One thread's counters. Only the owner writes them.
+struct Block {
+  std::atomic<unsigned long> counts[METRIC_COUNT];
+};
+
+extern thread_local Block* local_block;
+Block* registerThread();
+
+inline void add(MetricId id, unsigned long n) {
+  Block* block = local_block;
+  if (!block)
+    block = registerThread();
+  std::atomic<unsigned long>& c = block->counts[id];
+  c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// For gauges: replaces the calling thread's value. read() adds up the
+// threads, so a gauge must only ever be set from one of them.
+inline void set(MetricId id, unsigned long n) {
+  Block* block = local_block;
+  if (!block)
+    block = registerThread();
+  block->counts[id].store(n, std::memory_order_relaxed);
+}
+
+const char* name(MetricId id);
+// Sum over all threads.
+unsigned long read(MetricId id);
+void reset();
+// One "name value" line per counter.
+void dump(std::ostream& out);
+
+}
+
+#define METRIC_ADD(id, n) metrics::add(id, n)
+#define METRIC_INC(id) metrics::add(id, 1)
+#define METRIC_SET(id, n) metrics::set(id, n)
+#define METRICS_DUMP(out) metrics::dump(out)
+
+#else
+
+#define METRIC_ADD(id, n) ((void)0)
+#define METRIC_INC(id) ((void)0)
+#define METRIC_SET(id, n) ((void)0)
+#define METRICS_DUMP(out) ((void)0)
+
+#endif
+
+#endif
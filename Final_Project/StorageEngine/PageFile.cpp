@@ -0,0 +1,137 @@
+#include "PageFile.h"
+#include "StorageEngine.h"
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+
+using namespace std;
+
+PageFile::PageFile() {
+  fd = -1;
+  direct = false;
+  frames = NULL;
+  frame_count = 0;
+}
+
+PageFile::~PageFile() {
+  close();
+}
+
+bool PageFile::open(const string& filename, bool new_direct, unsigned new_frame_count) {
+  close();
+  int flags = O_RDWR | O_CREAT | O_TRUNC;
+  direct = false;
+  if (new_direct) {
+    fd = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+    direct = fd >= 0;
+  }
+  if (fd < 0) //buffered, or O_DIRECT is not supported here
+    fd = ::open(filename.c_str(), flags, 0644);
+  if (fd < 0)
+    return false;
+
+  void* p = NULL;
+  if (posix_memalign(&p, PAGE_FILE_FRAME, (size_t)PAGE_FILE_FRAME * new_frame_count) != 0) {
+    close();
+    return false;
+  }
+  frames = (char*)p;
+  frame_count = new_frame_count;
+  return true;
+}
+
+void PageFile::close() {
+  if (fd >= 0)
+    ::close(fd);
+  fd = -1;
+  free(frames);
+  frames = NULL;
+  frame_count = 0;
+}
+
+bool PageFile::read(unsigned frame, Page& page) {
+  if (!readInPlace(frame, page))
+    return false;
+  page.data.assign(data(frame), dataLength(frame));
+  return true;
+}
+
+bool PageFile::readInPlace(unsigned frame, Page& page) {
+  char* buf = frameBuffer(frame);
+  if (!buf)
+    return false;
+  if (pread(fd, buf, PAGE_FILE_FRAME, slotOffset(page.page_id)) != (ssize_t)PAGE_FILE_FRAME)
+    return false;
+  return loadHeader(frame, page);
+}
+
+bool PageFile::writeInPlace(unsigned frame, const Page& page) {
+  const char* buf = seal(frame, page);
+  if (!buf)
+    return false;
+  return pwrite(fd, buf, PAGE_FILE_FRAME, slotOffset(page.page_id)) == (ssize_t)PAGE_FILE_FRAME;
+}
+
+char* PageFile::frameBuffer(unsigned frame) {
+  if (frame >= frame_count)
+    return NULL;
+  return frames + (size_t)frame * PAGE_FILE_FRAME;
+}
+
+bool PageFile::loadHeader(unsigned frame, Page& page) {
+  const char* buf = frameBuffer(frame);
+  if (!buf || dataLength(frame) > capacity())
+    return false;
+  int32_t lsn;
+  memcpy(&lsn, buf, 4);
+  page.pageLSN = lsn;
+  page.dirty = false;
+  page.data.clear();
+  return true;
+}
+
+const char* PageFile::seal(unsigned frame, const Page& page) {
+  char* buf = frameBuffer(frame);
+  if (!buf)
+    return NULL;
+  int32_t lsn = page.pageLSN;
+  memcpy(buf, &lsn, 4);
+  return buf;
+}
+
+char* PageFile::data(unsigned frame) {
+  return frames + (size_t)frame * PAGE_FILE_FRAME + 8;
+}
+
+unsigned PageFile::dataLength(unsigned frame) {
+  uint32_t length;
+  memcpy(&length, frames + (size_t)frame * PAGE_FILE_FRAME + 4, 4);
+  return length;
+}
+
+void PageFile::setDataLength(unsigned frame, unsigned length) {
+  uint32_t stored = length;
+  memcpy(frames + (size_t)frame * PAGE_FILE_FRAME + 4, &stored, 4);
+}
+
+bool PageFile::write(unsigned frame, const Page& page) {
+  const char* buf = stage(frame, page);
+  if (!buf)
+    return false;
+  return pwrite(fd, buf, PAGE_FILE_FRAME, slotOffset(page.page_id)) == (ssize_t)PAGE_FILE_FRAME;
+}
+
+const char* PageFile::stage(unsigned frame, const Page& page) {
+  if (frame >= frame_count || page.data.length() > capacity())
+    return NULL;
+  char* buf = frames + (size_t)frame * PAGE_FILE_FRAME;
+  int32_t lsn = page.pageLSN;
+  uint32_t length = page.data.length();
+  memcpy(buf, &lsn, 4);
+  memcpy(buf + 4, &length, 4);
+  memcpy(buf + 8, page.data.data(), length);
+  memset(buf + 8 + length, 0, PAGE_FILE_FRAME - 8 - length);
+  return buf;
+}
@@ -0,0 +1,99 @@
+#ifndef PAGEFILE_H_
+#define PAGEFILE_H_
+
+#include <string>
+#include <sys/types.h>
+
+struct Page;
+
+// Size and alignment of a page slot in the file and of an I/O frame.
+const unsigned PAGE_FILE_FRAME = 4096;
+
+/*
+ * The pages of a database in a file of fixed 4KiB slots, page_id 1 in
+ * the first. A slot holds the pageLSN and data length as two 4-byte
+ * integers, then the data.
+ *
+ * I/O goes through frames of PAGE_FILE_FRAME bytes aligned to
+ * PAGE_FILE_FRAME, one per buffer pool frame, so the file can be opened
+ * with O_DIRECT and bypass the OS page cache. The buffer pool keeps
+ * each page's data in its frame's slot image, so those frames are all
+ * the memory its pages take.
+ */
+class PageFile {
+ public:
+  PageFile();
+  ~PageFile();
+
+  /*
+   * Creates or truncates filename and allocates frame_count I/O frames.
+   * With direct, opens with O_DIRECT, falling back to buffered I/O if
+   * the file system refuses it; see isDirect(). Returns false if the
+   * file cannot be opened.
+   */
+  bool open(const std::string& filename, bool direct, unsigned frame_count);
+  void close();
+
+  bool isOpen() const { return fd >= 0; }
+  bool isDirect() const { return direct; }
+  int descriptor() const { return fd; }
+
+  // Where the slot of page_id starts in the file.
+  static off_t slotOffset(int page_id) { return (off_t)(page_id - 1) * PAGE_FILE_FRAME; }
+
+  // Largest page data a slot can hold.
+  static unsigned capacity() { return PAGE_FILE_FRAME - 8; }
+
+  /*
+   * Reads the slot of page.page_id through I/O frame `frame` into page.
+   * Returns false on an I/O error or short read.
+   */
+  bool read(unsigned frame, Page& page);
+
+  /*
+   * Writes page to its slot through I/O frame `frame`. Returns false on
+   * an I/O error or if the data does not fit.
+   */
+  bool write(unsigned frame, const Page& page);
+
+  /*
+   * Fills I/O frame `frame` with the slot image of page and returns it,
+   * for a caller doing its own I/O; NULL if the data does not fit.
+   */
+  const char* stage(unsigned frame, const Page& page);
+
+  /*
+   * For a page kept in its I/O frame: readInPlace reads the slot of
+   * page.page_id into frame and sets page.pageLSN from it, leaving the
+   * data there, and writeInPlace writes frame back to the slot with
+   * page.pageLSN. Both return false as read and write do.
+   */
+  bool readInPlace(unsigned frame, Page& page);
+  bool writeInPlace(unsigned frame, const Page& page);
+
+  /*
+   * The same in steps, for a caller doing its own I/O: frameBuffer is
+   * the whole slot image of frame, loadHeader sets page.pageLSN from
+   * an image read into it, false if that is not a valid slot, and seal
+   * stores page.pageLSN in the image and returns it, ready to write.
+   */
+  char* frameBuffer(unsigned frame);
+  bool loadHeader(unsigned frame, Page& page);
+  const char* seal(unsigned frame, const Page& page);
+
+  // The page data in the slot image of frame, and its length.
+  char* data(unsigned frame);
+  unsigned dataLength(unsigned frame);
+  void setDataLength(unsigned frame, unsigned length);
+
+ private:
+  int fd;
+  bool direct;
+  char* frames;
+  unsigned frame_count;
+
+  PageFile(const PageFile&);
+  PageFile& operator=(const PageFile&);
+};
+
+#endif
@@ -1,13 +1,53 @@
 #include "StorageEngine.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include "../StudentComponent/LogMgr.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
 #include <cstring>
 #include <string>
+#include <string_view>
 #include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
+// Unchanged bytes between two changed runs cost less to log again than a
+// second update record header, so runs closer than this are merged.
+static const unsigned DIFF_GAP = 16;
+
+// Deferred pages recovered alongside each operation after an instant
+// restart or with background undo.
+static const unsigned BACKGROUND_RECOVERY_PAGES = 1;
+
+// Writes between two checks of the flush controller, and the log bytes
+// per second a restart is taken to get through until one has been timed.
+static const unsigned FLUSH_CONTROL_WRITES = 16;
+static const double DEFAULT_RESTART_BYTES_PER_SEC = 20e6;
+
 StorageEngine::StorageEngine() : MEMORY_SIZE(10) {
     page_writes_permitted = 0;
+    restart_bytes_per_sec = DEFAULT_RESTART_BYTES_PER_SEC;
+    records.resize(MEMORY_SIZE);
+    pin_counts.resize(MEMORY_SIZE, 0);
+    clearBuffer();
+}
+
+StorageEngine::~StorageEngine() {
+    if (commit_flusher.joinable()) {
+      {
+        lock_guard<recursive_mutex> guard(engine_mutex);
+        commit_flusher_stopping = true;
+      }
+      commit_flush_wake.notify_one();
+      commit_flusher.join();
+    }
+    delete async_io;
 }
 
 /* 
@@ -16,6 +56,7 @@ StorageEngine::StorageEngine() : MEMORY_SIZE(10) {
  * Also sets the associated LogMgr and the logfile name.
  */
 void StorageEngine::start(string db_filename, LogMgr* log_mgr_ptr, string testcase_num) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
 
   lm_ptr = log_mgr_ptr;
   log_filename = "output/log/log";
@@ -44,16 +85,43 @@ void StorageEngine::start(string db_filename, LogMgr* log_mgr_ptr, string testca
   }
 
   dbf.close();
+  page_frame.assign(onDisk.size() + 1, -1);
+
+  if (!page_filename.empty()) {
+    //one frame per buffer frame, and one for start() and end()
+    bool ok = page_file.open(page_filename, page_file_direct, MEMORY_SIZE + 1);
+    for (unsigned i = 0; ok && i < onDisk.size(); ++i)
+      ok = page_file.write(MEMORY_SIZE, onDisk[i]);
+    if (!ok) {
+      cerr << "cannot keep pages in " << page_filename << ", keeping them in memory" << endl;
+      page_file.close();
+      return;
+    }
+    for (unsigned i = 0; i < onDisk.size(); ++i)
+      string().swap(onDisk[i].data);
+  }
 }
 
 void StorageEngine::end(string db_filename) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  //Finish what an instant restart or background undo left
+  runDeferredRecovery(NULL_TX, -1, UINT_MAX);
+  //Async commits are made durable before shutting down
+  lm_ptr->flushCommits();
   //For each page in onDisk, 
     //write the page to db_filename 
   ofstream dbf(db_filename);
   for(unsigned i = 0; i < onDisk.size(); ++i) {
+    if (page_file.isOpen()) {
+      Page p = onDisk[i];
+      page_file.read(MEMORY_SIZE, p);
+      dbf << p.pageLSN << ' ' << p.data << endl;
+      continue;
+    }
     dbf << onDisk[i].pageLSN << ' ' << onDisk[i].data << endl;
   }
   dbf.close();
+  METRICS_DUMP(cerr);
 }
 
 /* 
@@ -67,42 +135,465 @@ void StorageEngine::end(string db_filename) {
  * 
  */
 void StorageEngine::crash(int safe_writes, LogMgr* log_mgr_ptr) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  TraceScope scope("crash");
+  scope.arg("safe_writes", safe_writes);
   page_writes_permitted = safe_writes;
   lm_ptr = log_mgr_ptr;
-  records.clear();
-  string log = getLog();
+  commit_flush_lm = NULL; //async commits not yet on disk are lost
+  recovery_deferred = false;
+  clearBuffer();
+  //a LogMgr resuming an interrupted recovery has parsed the start already
+  size_t known = lm_ptr->recoveredLogBytes();
+  string log = getLog(log_compression ? 0 : known);
+  if (log_compression) { //the compressor's history did not survive the crash
+    log_compressor.reset(log_segment_bytes > 0 ? "" : log);
+    log.erase(0, known);
+  }
   lm_ptr->recover(log);
+  RecoveryStats timed = lm_ptr->getRecoveryStats();
+  double seconds = timed.parse_seconds + timed.analyze_seconds + timed.redo_seconds;
+  if (timed.redone && seconds > 0 && !log.empty()) //what the flush controller estimates by
+    restart_bytes_per_sec = log.length() / seconds;
+  recovery_deferred = lm_ptr->recoveryDeferred();
+  recovery_writes_permitted = page_writes_permitted;
 }
 
 void StorageEngine::end_crash(LogMgr* log_mgr_ptr) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
   lm_ptr = log_mgr_ptr;
   page_writes_permitted = 0;
 }
 
+void StorageEngine::setDiffLogging(bool enabled) {
+  diff_logging = enabled;
+}
+
+void StorageEngine::setPageFlushLogging(bool enabled) {
+  page_flush_logging = enabled;
+}
+
+bool StorageEngine::pageFlushLogging() {
+  return page_flush_logging;
+}
+
+void StorageEngine::setPageSortedRedo(bool enabled) {
+  page_sorted_redo = enabled;
+}
+
+bool StorageEngine::pageSortedRedo() {
+  return page_sorted_redo;
+}
+
+void StorageEngine::setInstantRestart(bool enabled) {
+  instant_restart = enabled;
+}
+
+bool StorageEngine::instantRestart() {
+  return instant_restart;
+}
+
+void StorageEngine::setBackgroundUndo(bool enabled) {
+  background_undo = enabled;
+}
+
+bool StorageEngine::backgroundUndo() {
+  return background_undo;
+}
+
+void StorageEngine::setPageChainLogging(bool enabled) {
+  page_chain_logging = enabled;
+}
+
+bool StorageEngine::pageChainLogging() {
+  return page_chain_logging;
+}
+
+bool StorageEngine::repairPage(int page_id) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  if (!page_chain_logging || page_id < 1 || page_id >= (int)onDisk.size())
+    return false;
+  if (recovery_deferred) //the chain covers what recovery would redo
+    runDeferredRecovery(NULL_TX, page_id, 0);
+  if (page_frame[page_id] >= 0 && pin_counts[page_frame[page_id]] > 0)
+    return false;
+  vector<WriteOp> writes;
+  vector<int> lsns;
+  if (!lm_ptr->pageChain(page_id, onDisk[page_id-1].pageLSN, writes, lsns))
+    return false;
+  discardPage(page_id);
+  int i = findPage(page_id);
+  if (i < 0) //not buffered, and every frame is pinned
+    return false;
+  for (unsigned k = 0; k < writes.size(); ++k) {
+    replaceInFrame(i, writes[k].offset, writes[k].bytes);
+    records[i].pageLSN = lsns[k];
+    records[i].dirty = true;
+  }
+  return true;
+}
+
+bool StorageEngine::damagePage(int page_id) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  if (!isBuffered(page_id) || pin_counts[page_frame[page_id]] > 0)
+    return false;
+  int i = page_frame[page_id];
+  replaceInFrame(i, 0, string(frameLength(i), '#'));
+  return true;
+}
+
+void StorageEngine::setAsyncCommit(bool enabled, unsigned max_delay_ms, unsigned long max_bytes) {
+  async_commit = enabled;
+  async_commit_ms = max_delay_ms;
+  async_commit_bytes = max_bytes;
+}
+
+bool StorageEngine::asyncCommit() {
+  return async_commit;
+}
+
+unsigned StorageEngine::asyncCommitDelayMs() {
+  return async_commit_ms;
+}
+
+unsigned long StorageEngine::asyncCommitBytes() {
+  return async_commit_bytes;
+}
+
+void StorageEngine::scheduleCommitFlush(LogMgr* lm, chrono::steady_clock::time_point due) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  commit_flush_lm = lm;
+  commit_flush_due = due;
+  if (!commit_flusher.joinable())
+    commit_flusher = thread(&StorageEngine::runCommitFlusher, this);
+  commit_flush_wake.notify_one();
+}
+
+void StorageEngine::cancelCommitFlush(LogMgr* lm) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  if (commit_flush_lm == lm)
+    commit_flush_lm = NULL;
+}
+
+recursive_mutex& StorageEngine::engineMutex() {
+  return engine_mutex;
+}
+
+/*
+ * The commit flusher: sleeps until the oldest async commit is due, then
+ * has its LogMgr force the log, which schedules the next one if any.
+ * Whatever work comes in first does the same and moves the deadline.
+ */
+void StorageEngine::runCommitFlusher() {
+  unique_lock<recursive_mutex> guard(engine_mutex);
+  while (!commit_flusher_stopping) {
+    if (commit_flush_lm == NULL) {
+      commit_flush_wake.wait(guard);
+    } else if (chrono::steady_clock::now() < commit_flush_due) {
+      commit_flush_wake.wait_until(guard, commit_flush_due);
+    } else {
+      LogMgr* lm = commit_flush_lm;
+      commit_flush_lm = NULL;
+      lm->flushDueCommits();
+    }
+  }
+}
+
+void StorageEngine::setRecoveryTarget(double target_ms) {
+  recovery_target_ms = target_ms;
+}
+
+double StorageEngine::recoveryTargetMs() {
+  return recovery_target_ms;
+}
+
+FlushControlStats StorageEngine::getFlushControlStats() {
+  return flush_control;
+}
+
+void StorageEngine::recoverDeferred(int txid) {
+  runDeferredRecovery(txid, -1, BACKGROUND_RECOVERY_PAGES);
+}
+
+bool StorageEngine::recoverDeferredPage(int page_id) {
+  if (in_deferred_recovery) //already writing under the crash's budget
+    return lm_ptr->recoverPage(page_id);
+  runDeferredRecovery(NULL_TX, page_id, 0);
+  return true;
+}
+
+void StorageEngine::setPageFile(const string& filename, bool direct) {
+  page_filename = filename;
+  page_file_direct = direct;
+}
+
+bool StorageEngine::pageFileDirect() {
+  return page_file.isDirect();
+}
+
+void StorageEngine::setAsyncIO(bool enabled, bool use_uring) {
+  delete async_io;
+  async_io = enabled ? AsyncIO::create(use_uring, 64) : NULL;
+}
+
+const char* StorageEngine::asyncIOBackend() {
+  return async_io ? async_io->name() : "off";
+}
+
+void StorageEngine::setLogCompression(bool enabled) {
+  log_compression = enabled;
+}
+
+void StorageEngine::setLogSegmentBytes(unsigned long bytes, bool archive) {
+  log_segment_bytes = bytes;
+  log_archiving = archive;
+}
+
+LogIOStats StorageEngine::getLogIOStats() {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  return log_stats;
+}
+
 
 /* 
- * update_log(log_entries)
+ * update_log(log_entries, first_lsn, last_lsn)
  *
- * We will append the log entries to the end of our log file.
+ * We will append the log entries to the end of our log file, or of the
+ * active segment when the log is split into segments.
  *
  */
-void StorageEngine::updateLog(string log_entries) {
+void StorageEngine::updateLog(const string& log_entries, int first_lsn, int last_lsn) {
+    updateLog(log_entries.data(), log_entries.length(), first_lsn, last_lsn);
+}
+
+void StorageEngine::updateLog(const char* log_entries, size_t length, int first_lsn, int last_lsn) {
 //find the file called [log_filename]. If it doesn't exist, create it.
 //Append the string log_entries to the end of it.
 //Close it.
-    ofstream myfile;
-    myfile.open(log_filename, std::ios_base::app);
-    if (!myfile.is_open()){
-        std::ofstream outfile (log_filename);
-        outfile << log_entries;
-        outfile.close();
+    TraceScope scope("flush_log");
+    scope.arg("bytes", length);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    ++log_stats.flushes;
+    log_stats.raw_bytes += length;
+    METRIC_ADD(METRIC_LOG_BYTES_WRITTEN, length);
+    string filename = log_filename;
+    if (log_segment_bytes > 0) {
+      if (length == 0)
+	return;
+      filename = activeSegment(length, first_lsn);
     }
-    else{
-        myfile << log_entries;
+    if (page_chain_logging && !log_compression && length > 0 && first_lsn != -1) {
+      LogFlushMark mark;
+      struct stat st;
+      mark.first_lsn = first_lsn;
+      mark.last_lsn = last_lsn;
+      mark.segment_lsn = log_segment_bytes > 0 ? log_segments.back().first_lsn : -1;
+      mark.offset = stat(filename.c_str(), &st) == 0 ? st.st_size : 0;
+      mark.length = length;
+      log_flushes.push_back(mark);
     }
-    
-    myfile.close();
-    
+    unsigned long stored = length;
+    if (log_compression) {
+      stored = appendLogBlock(filename, string(log_entries, length));
+    }
+    else if (async_io) {
+      appendLogAsync(filename, log_entries, length);
+    }
+    else {
+      ofstream myfile;
+      myfile.open(filename, std::ios_base::app);
+      if (!myfile.is_open()){
+          std::ofstream outfile (filename);
+          outfile.write(log_entries, length);
+          outfile.close();
+      }
+      else{
+          myfile.write(log_entries, length);
+      }
+      
+      myfile.close();
+    }
+    log_stats.stored_bytes += stored;
+    if (log_segment_bytes > 0) {
+      log_segments.back().bytes += stored;
+      if (last_lsn != -1)
+	log_segments.back().last_lsn = last_lsn;
+    }
+    log_stats.flush_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Appends the length bytes at log_entries to filename through the AsyncIO
+ * queue and waits until they are on stable storage.
+ */
+void StorageEngine::appendLogAsync(const string& filename, const char* log_entries, size_t length) {
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    cerr << "cannot append to " << filename << endl;
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+  if (length == 0) { //a force with nothing left to write
+    close(fd);
+    return;
+  }
+  async_io->pwrite(fd, log_entries, length, st.st_size);
+  async_io->fdatasync(fd);
+  if (!async_io->drain())
+    cerr << "cannot append to " << filename << endl;
+  close(fd);
+}
+
+/*
+ * activeSegment(incoming, first_lsn)
+ *
+ * Returns the file the next incoming bytes of log go to. Seals the 
+ * active segment, renaming it to its final LSN range, if they would 
+ * take it past log_segment_bytes; a flush is never split.
+ */
+string StorageEngine::activeSegment(unsigned long incoming, int first_lsn) {
+  if (!log_segments.empty()) {
+    LogSegment& active = log_segments.back();
+    if (active.bytes == 0 || active.bytes + incoming <= log_segment_bytes)
+      return active.filename;
+    string sealed = segmentName(active.first_lsn, to_string(active.last_lsn));
+    rename(active.filename.c_str(), sealed.c_str());
+    active.filename = sealed;
+  }
+  //each segment decodes on its own, so it can be dropped independently
+  log_compressor.reset("");
+  LogSegment next;
+  next.first_lsn = first_lsn;
+  next.last_lsn = first_lsn;
+  next.bytes = 0;
+  next.filename = segmentName(first_lsn, "open");
+  log_segments.push_back(next);
+  return next.filename;
+}
+
+/*
+ * segmentName(first_lsn, last)
+ *
+ * output/log/log00.log becomes output/log/log00.<first_lsn>-<last>.log
+ */
+string StorageEngine::segmentName(int first_lsn, string last) {
+  string prefix = log_filename;
+  if (prefix.length() > 4 && prefix.compare(prefix.length() - 4, 4, ".log") == 0)
+    prefix.erase(prefix.length() - 4);
+  return prefix + "." + to_string(first_lsn) + "-" + last + ".log";
+}
+
+/*
+ * truncateLog(horizon_lsn)
+ *
+ * Removes the sealed segments, oldest first, whose records all have 
+ * LSNs below horizon_lsn. With archiving on they are moved into an 
+ * archive directory next to the log instead of being deleted.
+ */
+void StorageEngine::truncateLog(int horizon_lsn) {
+  if (log_segment_bytes == 0 || horizon_lsn == -1)
+    return;
+  while (log_segments.size() > 1 && log_segments[0].last_lsn < horizon_lsn) {
+    const string& filename = log_segments[0].filename;
+    if (log_archiving) {
+      size_t slash = filename.rfind('/');
+      string dir = filename.substr(0, slash + 1) + "archive";
+      mkdir(dir.c_str(), 0755);
+      rename(filename.c_str(), (dir + filename.substr(slash)).c_str());
+    } else {
+      remove(filename.c_str());
+    }
+    ++log_stats.segments_removed;
+    while (!log_flushes.empty() && log_flushes.front().segment_lsn == log_segments[0].first_lsn)
+      log_flushes.erase(log_flushes.begin());
+    log_segments.erase(log_segments.begin());
+  }
+}
+
+static void putVarint(unsigned v, string& out) {
+  while (v >= 0x80) {
+    out += (char)(v | 0x80);
+    v >>= 7;
+  }
+  out += (char)v;
+}
+
+static bool getVarint(istream& in, unsigned& v) {
+  v = 0;
+  char c;
+  for (int shift = 0; shift < 35 && in.get(c); shift += 7) {
+    unsigned char b = c;
+    v |= (unsigned)(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+/*
+ * appendLogBlock(filename, log_entries)
+ *
+ * Appends log_entries to filename as one block: its raw length, then its stored
+ * length shifted left one bit with the low bit set if the block is kept
+ * uncompressed (both as varints), then the stored bytes. Returns the
+ * number of bytes written.
+ */
+unsigned long StorageEngine::appendLogBlock(const string& filename, const string& log_entries) {
+  string packed;
+  log_compressor.compress(log_entries, packed);
+  string block;
+  putVarint(log_entries.length(), block);
+  if (packed.length() < log_entries.length()) {
+    putVarint(packed.length() << 1, block);
+    block += packed;
+  } else {
+    putVarint((log_entries.length() << 1) | 1, block);
+    block += log_entries;
+  }
+  ofstream myfile(filename, ios_base::app | ios_base::binary);
+  myfile << block;
+  myfile.close();
+  return block.length();
+}
+
+/*
+ * readLogBlocks(filename)
+ *
+ * Reads a block-format log file one block at a time, decoding each onto
+ * the text decoded so far, so only one stored block is held at once.
+ * The decoded text is kept whole: LogMgr::recover takes the log as one
+ * string, and a block may copy from the text before it. Stops at the
+ * first torn or malformed block.
+ */
+string StorageEngine::readLogBlocks(const string& filename) {
+  ifstream input(filename, ios_base::binary);
+  input.seekg(0, ios_base::end);
+  streamoff size = input ? (streamoff)input.tellg() : 0;
+  input.seekg(0);
+
+  string wholefile, block;
+  unsigned raw_len, stored;
+  while (getVarint(input, raw_len) && getVarint(input, stored)) {
+    unsigned len = stored >> 1;
+    if (len > size - (streamoff)input.tellg())
+      break;
+    block.resize(len);
+    if (!input.read(&block[0], len))
+      break;
+    if (stored & 1) {
+      wholefile += block;
+    } else {
+      size_t before = wholefile.length();
+      if (!decompressLogBlock(block.data(), len, raw_len, wholefile)) {
+	wholefile.resize(before);
+	break;
+      }
+    }
+  }
+
+  return wholefile;
 }
 
 /* 
@@ -113,21 +604,420 @@ void StorageEngine::updateLog(string log_entries) {
  * 
  */
 void StorageEngine::write(int txid, int page_id, int offset, string input) {
+    lock_guard<recursive_mutex> guard(engine_mutex);
+    if (!LogMgr::validTxid(txid))
+      return;
+    runDeferredRecovery(txid, -1, BACKGROUND_RECOVERY_PAGES);
+    if (diff_logging) {
+      writeBatch(txid, vector<WriteOp>(1, WriteOp(page_id, offset, input)));
+      return;
+    }
     //Use findPage() to get the page's location in records vector
     int getindex = findPage(page_id);
+    if (getindex < 0) //no such page, or every frame is pinned
+      return;
+    if (!fitsPage(page_id, frameLength(getindex), offset, input.length()))
+      return;
     //old = whatever's on the page at the offset; length of old should be same as length of input
-    string old;
-    for (unsigned i = 0; i<input.length(); ++i) {
-      old += records[getindex].data[offset+i];
-    }
+    string old = frameBytes(getindex, offset, input.length());
     int pageLSN = lm_ptr->write(txid, page_id, offset, input, old);
     //write the updated page
     updatePage(page_id, offset, input);
     //and update the pageLSN for the page
     updateLSN(page_id, pageLSN);
+    controlFlushing();
+}
+
+/*
+ * read(txid, page_id, offset, len)
+ *
+ * Copies len bytes of the page starting from the offset byte. 
+ * There is no lock manager, so txid is not used yet.
+ */
+string StorageEngine::read(int txid, int page_id, int offset, int len) {
+  PageView view = readView(txid, page_id, offset, len);
+  if (view.data == NULL)
+    return "";
+  string result(view.data, view.length);
+  unpin(view);
+  return result;
+}
+
+/*
+ * readView(txid, page_id, offset, len)
+ *
+ * Pins the page and returns a pointer to the requested bytes inside 
+ * its frame. The caller must unpin(view) once done with it.
+ */
+PageView StorageEngine::readView(int txid, int page_id, int offset, int len) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  runDeferredRecovery(txid, -1, BACKGROUND_RECOVERY_PAGES);
+  if (!pinPage(page_id))
+    return PageView();
+  int i = page_frame[page_id];
+  int length = frameLength(i);
+  if (offset < 0 || offset > length)
+    offset = length;
+  if (len < 0 || len > length - offset)
+    len = length - offset;
+  return PageView(page_id, frameData(i) + offset, len);
+}
+
+void StorageEngine::unpin(const PageView& view) {
+  if (view.data != NULL)
+    unpinPage(view.page_id);
+}
+
+bool StorageEngine::pinPage(int page_id) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  int i = findPage(page_id);
+  if (i < 0)
+    return false;
+  ++pin_counts[i];
+  return true;
+}
+
+bool StorageEngine::isBuffered(int page_id) {
+  return page_id >= 1 && page_id < (int)page_frame.size() && page_frame[page_id] >= 0;
+}
+
+unsigned StorageEngine::pinPages(const vector<int>& page_ids) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  if (!async_io || !page_file.isOpen() || recovery_deferred) {
+    unsigned n = 0;
+    while (n < page_ids.size() && pinPage(page_ids[n]))
+      ++n;
+    return n;
+  }
+
+  //pin the pages already buffered first, so none is picked as a victim
+  unsigned n = 0;
+  vector<bool> hit(page_ids.size(), false);
+  for (; n < page_ids.size(); ++n) {
+    int page_id = page_ids[n];
+    if (page_id < 1 || page_id >= (int)onDisk.size())
+      break;
+    if (page_frame[page_id] >= 0) {
+      hit[n] = true;
+      ++pin_counts[page_frame[page_id]];
+    }
+  }
+  //then find a frame for each miss, free or evicted as findPage would
+  vector<int> loads;
+  vector<int> victims;
+  unsigned spare = free_frames.size();
+  int next = (int)resident.size() - 1;
+  for (unsigned k = 0; k < n; ++k) {
+    if (hit[k] || find(loads.begin(), loads.end(), page_ids[k]) != loads.end())
+      continue;
+    if (spare > 0) {
+      --spare;
+    } else {
+      while (next >= 0 && pin_counts[resident[next]] > 0)
+        --next;
+      if (next < 0) { //every frame is pinned
+        for (unsigned j = k; j < n; ++j)
+          if (hit[j])
+            --pin_counts[page_frame[page_ids[j]]];
+        n = k;
+        break;
+      }
+      victims.push_back(resident[next--]);
+    }
+    loads.push_back(page_ids[k]);
+  }
+  for (unsigned k = 0; k < n; ++k) {
+    if (hit[k]) {
+      ++buffer_stats.hits;
+      METRIC_INC(METRIC_PAGE_HITS);
+    }
+  }
+
+  vector<int> dirty;
+  for (unsigned k = 0; k < victims.size(); ++k) {
+    ++buffer_stats.evictions;
+    METRIC_INC(METRIC_EVICTIONS);
+    if (records[victims[k]].dirty)
+      dirty.push_back(victims[k]);
+  }
+  if (!dirty.empty())
+    writeBackFrames(dirty);
+  for (unsigned k = 0; k < victims.size(); ++k)
+    discardPage(records[victims[k]].page_id);
+
+  vector<int> frames;
+  for (unsigned k = 0; k < loads.size(); ++k) {
+    int i = free_frames.back();
+    free_frames.pop_back();
+    records[i] = onDisk[loads[k]-1];
+    async_io->pread(page_file.descriptor(), page_file.frameBuffer(i), PAGE_FILE_FRAME,
+                    PageFile::slotOffset(loads[k]));
+    resident.push_back(i);
+    page_frame[loads[k]] = i;
+    frames.push_back(i);
+    ++buffer_stats.misses;
+    METRIC_INC(METRIC_PAGE_MISSES);
+  }
+  bool ok = loads.empty() || async_io->drain();
+  //a page that cannot be read gets its frame back, and pinning stops
+  //there as it would at a page with no frame
+  unsigned read = n;
+  for (unsigned k = 0; k < frames.size(); ++k) {
+    if (ok && page_file.loadHeader(frames[k], records[frames[k]]))
+      continue;
+    cerr << "cannot read page " << loads[k] << " from " << page_filename << endl;
+    discardPage(loads[k]);
+    read = min(read, (unsigned)(find(page_ids.begin(), page_ids.begin() + n, loads[k]) - page_ids.begin()));
+  }
+  for (unsigned k = read; k < n; ++k) {
+    if (hit[k])
+      --pin_counts[page_frame[page_ids[k]]];
+  }
+  for (unsigned k = 0; k < read; ++k) {
+    if (!hit[k])
+      ++pin_counts[page_frame[page_ids[k]]];
+  }
+  return read;
+}
+
+void StorageEngine::unpinPage(int page_id) {
+  if (page_id < 1 || page_id >= (int)page_frame.size())
+    return;
+  int i = page_frame[page_id];
+  if (i >= 0 && pin_counts[i] > 0)
+    --pin_counts[i];
+}
+
+void StorageEngine::unpinPages(const vector<int>& page_ids, unsigned count) {
+  for (unsigned k = 0; k < count; ++k)
+    unpinPage(page_ids[k]);
+}
+
+BufferStats StorageEngine::getBufferStats() {
+  return buffer_stats;
+}
+
+void StorageEngine::resetBufferStats() {
+  buffer_stats = BufferStats();
+}
+
+unsigned StorageEngine::writeBackDirtyPages(unsigned max_pages) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  vector<int> frames;
+  for (unsigned j = 0; j < resident.size() && frames.size() < max_pages; ++j) {
+    if (records[resident[j]].dirty)
+      frames.push_back(resident[j]);
+  }
+  return writeBackFrames(frames);
+}
+
+/*
+ * Writes back the dirty pages in frames, leaving them buffered and
+ * clean, for writeBackDirtyPages and the flush controller.
+ */
+unsigned StorageEngine::writeBackFrames(const vector<int>& frames) {
+  if (async_io && page_file.isOpen()) {
+    //one log force for the whole batch, so each pageFlushed below
+    //finds its records on disk already
+    int max_lsn = -1;
+    for (unsigned k = 0; k < frames.size(); ++k)
+      max_lsn = max(max_lsn, records[frames[k]].pageLSN);
+    lm_ptr->forceLog(max_lsn);
+  }
+  for (unsigned k = 0; k < frames.size(); ++k) {
+    records[frames[k]].dirty = false;
+    METRIC_INC(METRIC_DIRTY_FLUSHES);
+    lm_ptr->pageFlushed(records[frames[k]].page_id);
+  }
+
+  if (!async_io || !page_file.isOpen()) {
+    for (unsigned k = 0; k < frames.size(); ++k)
+      writeDiskPage(frames[k]);
+    return frames.size();
+  }
+  for (unsigned k = 0; k < frames.size(); ++k) {
+    const Page& page = records[frames[k]];
+    const char* buf = page_file.seal(frames[k], page);
+    if (buf)
+      async_io->pwrite(page_file.descriptor(), buf, PAGE_FILE_FRAME, PageFile::slotOffset(page.page_id));
+    else
+      cerr << "cannot write page " << page.page_id << " to " << page_filename << endl;
+  }
+  async_io->fdatasync(page_file.descriptor());
+  if (!async_io->drain())
+    cerr << "cannot write pages to " << page_filename << endl;
+  for (unsigned k = 0; k < frames.size(); ++k)
+    onDisk[records[frames[k]].page_id-1].pageLSN = records[frames[k]].pageLSN;
+  return frames.size();
+}
+
+/*
+ * Every FLUSH_CONTROL_WRITES writes, with a recovery time target:
+ * estimates the restart time from the oldest recLSN among the dirty
+ * buffered pages, adjusts flush_rate to it and writes back that many
+ * pages, oldest recLSN first. Pages in the dirty page table that are
+ * not dirty in the buffer need no redo and are passed over.
+ */
+void StorageEngine::controlFlushing() {
+  if (recovery_target_ms <= 0 || ++control_writes < FLUSH_CONTROL_WRITES)
+    return;
+  control_writes = 0;
+  vector<pair<int, int> > by_age;
+  lm_ptr->dirtyPagesByAge(by_age);
+  vector<int> frames;
+  for (unsigned k = 0; k < by_age.size(); ++k) {
+    int page_id = by_age[k].second;
+    if (isBuffered(page_id) && records[page_frame[page_id]].dirty)
+      frames.push_back(page_frame[page_id]);
+  }
+  int redo_lsn = lm_ptr->restartRedoLSN();
+  unsigned long redo_bytes = redo_lsn == NULL_LSN ? 0 : lm_ptr->logBytesSince(redo_lsn);
+  double estimate_ms = redo_bytes / restart_bytes_per_sec * 1000;
+  if (estimate_ms > recovery_target_ms)
+    flush_rate = min(MEMORY_SIZE, max(1u, flush_rate * 2));
+  else if (estimate_ms < recovery_target_ms / 2)
+    flush_rate /= 2;
+  if (frames.size() > flush_rate)
+    frames.resize(flush_rate);
+  unsigned written = frames.empty() ? 0 : writeBackFrames(frames);
+
+  ++flush_control.checks;
+  flush_control.pages_written += written;
+  flush_control.redo_bytes = redo_bytes;
+  flush_control.estimate_ms = estimate_ms;
+  flush_control.max_estimate_ms = max(flush_control.max_estimate_ms, estimate_ms);
+  METRIC_ADD(METRIC_CONTROL_FLUSHES, written);
+  METRIC_SET(METRIC_REDO_BYTES_EST, redo_bytes);
+  METRIC_SET(METRIC_RECOVERY_US_EST, (unsigned long)(estimate_ms * 1000));
+}
+
+static bool byPage(const WriteOp& a, const WriteOp& b) {
+  return a.page_id < b.page_id;
+}
+
+/*
+ * Appends to ops/olds the runs of op that differ from its before-image 
+ * old. A write running past the end of the page is logged whole, as
+ * write() would, since a run there has no before-image to undo to.
+ */
+static void diffRuns(const WriteOp& op, const string& old, 
+		     vector<WriteOp>& ops, vector<string>& olds) {
+  const string& bytes = op.bytes;
+  if (old.length() < bytes.length()) {
+    ops.push_back(op);
+    olds.push_back(old);
+    return;
+  }
+  unsigned i = 0;
+  while (i < bytes.length()) {
+    while (i < bytes.length() && bytes[i] == old[i])
+      ++i;
+    if (i == bytes.length())
+      break;
+    unsigned start = i;
+    unsigned end = i + 1;
+    unsigned same = 0;
+    for (i = end; i < bytes.length() && same < DIFF_GAP; ++i) {
+      if (bytes[i] == old[i]) {
+        ++same;
+      } else {
+        same = 0;
+        end = i + 1;
+      }
+    }
+    i = end;
+    ops.push_back(WriteOp(op.page_id, op.offset + start, bytes.substr(start, end - start)));
+    olds.push_back(old.substr(start, end - start));
+  }
+}
+
+/*
+ * writeBatch(txid, ops)
+ *
+ * Pins every page of the batch, refusing the whole batch unlogged if
+ * they cannot all be buffered at once. First pass: take the 
+ * before-images of each page's writes, replaying earlier writes of the
+ * batch on a scratch copy when they overlap. Then log the whole group,
+ * and second pass: apply the after-images to the still pinned frames
+ * and set each page's LSN to its last record.
+ */
+void StorageEngine::writeBatch(int txid, vector<WriteOp> ops) {
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  TraceScope scope("write_batch");
+  scope.arg("ops", ops.size());
+  if (!LogMgr::validTxid(txid))
+    return;
+  runDeferredRecovery(txid, -1, BACKGROUND_RECOVERY_PAGES);
+  stable_sort(ops.begin(), ops.end(), byPage);
+  if (!ops.empty() && (ops.front().page_id < 1 || ops.back().page_id >= (int)onDisk.size()))
+    return;
+
+  vector<int> pages;
+  for (unsigned i = 0; i < ops.size(); ++i) {
+    if (pages.empty() || pages.back() != ops[i].page_id)
+      pages.push_back(ops[i].page_id);
+  }
+  unsigned pinned = pinPages(pages);
+  if (pinned < pages.size()) { //more pages than frames to pin them in
+    unpinPages(pages, pinned);
+    return;
+  }
+
+  vector<string> olds;
+  olds.reserve(ops.size());
+  for (unsigned begin = 0; begin < ops.size(); ) {
+    int page_id = ops[begin].page_id;
+    unsigned end = begin;
+    while (end < ops.size() && ops[end].page_id == page_id)
+      ++end;
+    int frame = page_frame[page_id];
+    if (end - begin == 1) {
+      if (!fitsPage(page_id, frameLength(frame), ops[begin].offset, ops[begin].bytes.length())) {
+        unpinPages(pages, pages.size());
+        return;
+      }
+      olds.push_back(frameBytes(frame, ops[begin].offset, ops[begin].bytes.length()));
+    } else {
+      string scratch(frameData(frame), frameLength(frame));
+      for (unsigned i = begin; i < end; ++i) {
+        if (!fitsPage(page_id, scratch.length(), ops[i].offset, ops[i].bytes.length())) {
+          unpinPages(pages, pages.size());
+          return;
+        }
+        olds.push_back(scratch.substr(ops[i].offset, ops[i].bytes.length()));
+        scratch.replace(ops[i].offset, ops[i].bytes.length(), ops[i].bytes);
+      }
+    }
+    begin = end;
+  }
+
+  if (diff_logging) {
+    vector<WriteOp> runs;
+    vector<string> run_olds;
+    for (unsigned i = 0; i < ops.size(); ++i)
+      diffRuns(ops[i], olds[i], runs, run_olds);
+    ops.swap(runs);
+    olds.swap(run_olds);
+  }
+
+  if (ops.empty()) { //nothing changes
+    unpinPages(pages, pages.size());
+    return;
+  }
+  int lsn = lm_ptr->writeBatch(txid, ops, olds);
+  for (unsigned i = 0; i < ops.size(); ++i, ++lsn) {
+    int j = page_frame[ops[i].page_id];
+    records[j].dirty = true;
+    replaceInFrame(j, ops[i].offset, ops[i].bytes);
+    records[j].pageLSN = lsn;
+  }
+  unpinPages(pages, pages.size());
+  controlFlushing();
 }
 
 void StorageEngine::abort(int txid, int pages_allowed){
+  lock_guard<recursive_mutex> guard(engine_mutex);
+  runDeferredRecovery(txid, -1, BACKGROUND_RECOVERY_PAGES);
   page_writes_permitted = pages_allowed;
   lm_ptr->abort(txid);
 }
@@ -142,6 +1032,18 @@ int StorageEngine::nextLSN() {
   return log_sequence_number;
 }
 
+/*
+ * nextLSNs(int count)
+ *
+ * Advances the log_sequence_number by count and returns the first of 
+ * the LSNs handed out.
+ */
+int StorageEngine::nextLSNs(int count) {
+  int first = log_sequence_number + 1;
+  log_sequence_number += count;
+  return first;
+}
+
 /*
  * store_master(int lsn)
  *
@@ -167,9 +1069,24 @@ int StorageEngine::get_master() {
 */
 int StorageEngine::getLSN(int page_id) {
   int i = findPage(page_id);
+  if (i < 0)
+    return -1;
   return records[i].pageLSN;
 }
 
+void StorageEngine::getLSNs(const vector<int>& page_ids, vector<int>& lsns) {
+  lsns.resize(page_ids.size());
+  for (unsigned k = 0; k < page_ids.size(); ++k) {
+    int page_id = page_ids[k];
+    if (page_id < 1 || page_id >= (int)onDisk.size())
+      lsns[k] = -1;
+    else if (page_frame[page_id] >= 0)
+      lsns[k] = records[page_frame[page_id]].pageLSN;
+    else
+      lsns[k] = onDisk[page_id-1].pageLSN;
+  }
+}
+
 /*
  * Return the filename of output file
  */
@@ -181,13 +1098,67 @@ string StorageEngine::getOutputFileName() {
 * Returns as much of the log as is on disk
 */
 string StorageEngine::getLog() {
-//read the file [log_filename] in as a string, and return that.
+    return getLog(0);
+}
+
+string StorageEngine::getLog(size_t skip) {
+//read the file [log_filename], or each segment in turn, in as a string, and return that.
+    TraceScope scope("read_log");
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    string wholefile;
+    if (log_segment_bytes > 0) {
+      for (unsigned i = 0; i < log_segments.size(); ++i)
+	wholefile += readLogFile(log_segments[i].filename);
+      wholefile.erase(0, skip);
+    }
+    else if (log_compression) {
+      wholefile = readLogFile(log_filename);
+      wholefile.erase(0, skip);
+    }
+    else {
+      //every record is one nonempty line, so the file holds the text as is
+      wholefile = readLogFile(log_filename, skip);
+    }
+    log_stats.read_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    scope.arg("bytes", wholefile.length());
+    return wholefile;
+}
+
+static bool flushBefore(int lsn, const LogFlushMark& mark) {
+  return lsn < mark.first_lsn;
+}
+
+bool StorageEngine::readLogFlush(int lsn, string& text) {
+  vector<LogFlushMark>::const_iterator it =
+    upper_bound(log_flushes.begin(), log_flushes.end(), lsn, flushBefore);
+  if (it == log_flushes.begin() || (--it)->last_lsn < lsn)
+    return false;
+  string filename = log_filename;
+  if (it->segment_lsn != -1) {
+    filename.clear();
+    for (unsigned i = 0; i < log_segments.size(); ++i)
+      if (log_segments[i].first_lsn == it->segment_lsn)
+        filename = log_segments[i].filename;
+  }
+  ifstream input(filename, ios::binary);
+  if (filename.empty() || !input.seekg(it->offset))
+    return false;
+  text.resize(it->length);
+  input.read(&text[0], it->length);
+  return (size_t)input.gcount() == it->length;
+}
+
+string StorageEngine::readLogFile(const string& filename, size_t skip) {
+    if (log_compression)
+      return readLogBlocks(filename);
     string wholefile, tmp;
     
-    ifstream input(log_filename);
+    ifstream input(filename);
+    if (skip > 0)
+      input.seekg(skip);
     
-    while(!input.eof()) {
-        getline(input, tmp);
+    //a log not yet created reads as empty
+    while(getline(input, tmp)) {
 	if (tmp != "") {
 	  wholefile += tmp;
 	  wholefile += "\n";
@@ -205,7 +1176,12 @@ string StorageEngine::getLog() {
 * returns false and doesn't write the page. 
 */
 bool StorageEngine::pageWrite(int page_id, int offset, string text, int lsn) {
-  if (page_writes_permitted <= 0) 
+  if (page_writes_permitted <= 0) {
+    if (trace::enabled)
+      trace::instant("out_of_page_writes", "\"page_id\": " + to_string(page_id));
+    return false;
+  }
+  if (findPage(page_id) < 0) //no such page, or every frame is pinned
     return false;
   --page_writes_permitted;
   updatePage(page_id, offset, text);
@@ -216,32 +1192,76 @@ bool StorageEngine::pageWrite(int page_id, int offset, string text, int lsn) {
 
 //private
 
+/*
+ * Runs part of the recovery an instant restart or background undo
+ * deferred: rolls back txid if it is a loser, brings page_id up to
+ * date, then recovers up to background_pages more pages. It writes
+ * under the budget the crash left, not the caller's. Once that runs out
+ * the rest stays deferred but goes unwritten, as a plain restart would
+ * leave it.
+ */
+void StorageEngine::runDeferredRecovery(int txid, int page_id, unsigned background_pages) {
+  if (!recovery_deferred || in_deferred_recovery)
+    return;
+  in_deferred_recovery = true;
+  swap(page_writes_permitted, recovery_writes_permitted);
+  bool ok = lm_ptr->recoverTx(txid) && lm_ptr->recoverPage(page_id);
+  for (unsigned k = 0; ok && k < background_pages && lm_ptr->recoveryDeferred(); ++k)
+    ok = lm_ptr->recoverNextPage();
+  swap(page_writes_permitted, recovery_writes_permitted);
+  in_deferred_recovery = false;
+  recovery_deferred = lm_ptr->recoveryDeferred();
+}
+
 /* 
  * Returns the index of the specified page in the records vector.
  * If the desired page is not in the records vector, flushes some
  * other page from records to disk and reads the desired page
  * into records, then returns the index.
  *
- * return -1 if page not found in either records or onDisk
+ * return -1 if page not found in either records or onDisk, if every
+ * frame is pinned, or if the page file cannot be read
  */
 int StorageEngine::findPage(int page_id) {
-  if (page_id >= (int)onDisk.size()) //page does not exist
+  if (page_id < 1 || page_id >= (int)onDisk.size()) //page does not exist
     return -1;
+  if (recovery_deferred) //brought up to date before anyone sees it
+    runDeferredRecovery(NULL_TX, page_id, 0);
 
-  for (unsigned i = 0; i < records.size(); ++i)
-      if (records[i].page_id == page_id)
-          return i;
+  if (page_frame[page_id] >= 0) {
+    ++buffer_stats.hits;
+    METRIC_INC(METRIC_PAGE_HITS);
+    return page_frame[page_id];
+  }
+  ++buffer_stats.misses;
+  METRIC_INC(METRIC_PAGE_MISSES);
 
   // If did not return, that means page not found inside records.
-  if (records.size() >= MEMORY_SIZE){
-    Page p = records.back();
-    int page_id = p.page_id;
-    flushPage(page_id); 
+  // Evict the most recently loaded page that nobody has pinned.
+  if (free_frames.empty()) {
+    int victim = -1;
+    for (int i = (int)resident.size() - 1; i >= 0; --i) {
+      if (pin_counts[resident[i]] == 0) {
+        victim = resident[i];
+        break;
+      }
+    }
+    if (victim < 0) //every frame is pinned
+      return -1;
+    ++buffer_stats.evictions;
+    METRIC_INC(METRIC_EVICTIONS);
+    flushPage(records[victim].page_id);
   }
 
-  records.push_back(onDisk[page_id-1]);
-  return (int)records.size()-1;
-  
+  int i = free_frames.back();
+  free_frames.pop_back();
+  if (!readDiskPage(page_id, i)) {
+    free_frames.push_back(i);
+    return -1;
+  }
+  resident.push_back(i);
+  page_frame[page_id] = i;
+  return i;
 }
 
 /* 
@@ -250,27 +1270,164 @@ int StorageEngine::findPage(int page_id) {
  */
 void StorageEngine::updatePage(int page_id, int offset, string text) {
   int i = findPage(page_id);
+  if (i < 0)
+    return;
   records[i].dirty = true;
-  //update records[i].data to have the specified text at the specified offset. 
-  records[i].data.replace(offset, text.length(), text);
+  //update the page to have the specified text at the specified offset. 
+  replaceInFrame(i, offset, text);
+}
+
+/*
+ * With a page file a buffered page's data stays in the slot image of
+ * its I/O frame; otherwise it is records[frame].data.
+ */
+const char* StorageEngine::frameData(int frame) {
+  if (page_file.isOpen())
+    return page_file.data(frame);
+  return records[frame].data.data();
+}
+
+int StorageEngine::frameLength(int frame) {
+  if (page_file.isOpen())
+    return page_file.dataLength(frame);
+  return records[frame].data.length();
+}
+
+/*
+ * len bytes of the page in frame from offset, fewer at the end of the
+ * page, as std::string::substr gives them.
+ */
+string StorageEngine::frameBytes(int frame, int offset, size_t len) {
+  return string(string_view(frameData(frame), frameLength(frame)).substr(offset, len));
+}
+
+/*
+ * Whether len bytes can be written at offset of page_id, now length
+ * bytes long: the write must start within the page, and with a page
+ * file the page must still fit its slot. Prints why not. write and
+ * writeBatch check this before logging, so every logged update can be
+ * applied, by them and by redo.
+ */
+bool StorageEngine::fitsPage(int page_id, size_t length, int offset, size_t len) {
+  if (offset < 0 || (size_t)offset > length) {
+    cerr << "cannot write page " << page_id << " at offset " << offset
+	 << " past its end at " << length << endl;
+    return false;
+  }
+  if (page_file.isOpen() && offset + len > PageFile::capacity()) {
+    cerr << "cannot write page " << page_id << " past "
+	 << PageFile::capacity() << " bytes" << endl;
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Puts bytes at offset in the page in frame, growing it if they run
+ * past its end, as std::string::replace does.
+ */
+void StorageEngine::replaceInFrame(int frame, int offset, const string& bytes) {
+  if (!page_file.isOpen()) {
+    records[frame].data.replace(offset, bytes.length(), bytes);
+    return;
+  }
+  unsigned length = page_file.dataLength(frame);
+  if ((unsigned)offset > length || offset + bytes.length() > PageFile::capacity()) {
+    cerr << "cannot write page " << records[frame].page_id << " past "
+	 << PageFile::capacity() << " bytes" << endl;
+    return;
+  }
+  memcpy(page_file.data(frame) + offset, bytes.data(), bytes.length());
+  page_file.setDataLength(frame, max<size_t>(length, offset + bytes.length()));
 }
 
 void StorageEngine::flushPage(int page_id) {
   //If the page's dirty bit is true, set it false and update this page in onDisk, 
-  //Remove it from the records vector
-  for (unsigned i = 0; i < records.size(); ++i){
-    if (records[i].page_id == page_id) {
-      if (records[i].dirty){
-	records[i].dirty = false;
-	lm_ptr->pageFlushed(page_id);
-	onDisk[page_id-1] = records[i];
-      }
-      records.erase(records.begin() + i);
-    }
+  //Remove it from the buffer and free its frame
+  if (page_id < 1 || page_id >= (int)page_frame.size())
+    return;
+  int i = page_frame[page_id];
+  if (i < 0)
+    return;
+  if (records[i].dirty){
+    records[i].dirty = false;
+    METRIC_INC(METRIC_DIRTY_FLUSHES);
+    lm_ptr->pageFlushed(page_id);
+    writeDiskPage(i);
+  }
+  discardPage(page_id);
+}
+
+/*
+ * Frees a page's frame without writing the page back.
+ */
+void StorageEngine::discardPage(int page_id) {
+  int i = page_frame[page_id];
+  if (i < 0)
+    return;
+  for (unsigned j = 0; j < resident.size(); ++j) {
+    if (resident[j] == i) {
+      resident.erase(resident.begin() + j);
+      break;
     }
+  }
+  page_frame[page_id] = -1;
+  pin_counts[i] = 0;
+  free_frames.push_back(i);
 }
 
 void StorageEngine::updateLSN(int page_id, int newLSN) {
   int i = findPage(page_id);
+  if (i < 0)
+    return;
   records[i].pageLSN = newLSN;
 }
+
+/*
+ * Loads the on-disk copy of a page into a frame of the buffer. Returns
+ * false, with the frame's contents undefined, if it cannot be read.
+ */
+bool StorageEngine::readDiskPage(int page_id, int frame) {
+  records[frame] = onDisk[page_id-1];
+  if (!page_file.isOpen())
+    return true;
+  bool ok;
+  if (async_io) {
+    async_io->pread(page_file.descriptor(), page_file.frameBuffer(frame), PAGE_FILE_FRAME,
+                    PageFile::slotOffset(page_id));
+    ok = async_io->drain() && page_file.loadHeader(frame, records[frame]);
+  } else {
+    ok = page_file.readInPlace(frame, records[frame]);
+  }
+  if (!ok)
+    cerr << "cannot read page " << page_id << " from " << page_filename << endl;
+  return ok;
+}
+
+/*
+ * Writes the page in a frame of the buffer back to disk.
+ */
+void StorageEngine::writeDiskPage(int frame) {
+  Page& page = records[frame];
+  if (!page_file.isOpen()) {
+    onDisk[page.page_id-1] = page;
+    return;
+  }
+  if (!page_file.writeInPlace(frame, page))
+    cerr << "cannot write page " << page.page_id << " to " << page_filename << endl;
+  onDisk[page.page_id-1].pageLSN = page.pageLSN;
+}
+
+/*
+ * Empties every frame of the buffer without writing anything back.
+ */
+void StorageEngine::clearBuffer() {
+  resident.clear();
+  free_frames.clear();
+  for (int i = (int)MEMORY_SIZE - 1; i >= 0; --i) {
+    pin_counts[i] = 0;
+    free_frames.push_back(i);
+  }
+  for (unsigned i = 0; i < page_frame.size(); ++i)
+    page_frame[i] = -1;
+}
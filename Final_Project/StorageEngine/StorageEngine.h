@@ -1,8 +1,16 @@
 #ifndef STORAGEENGINE_H_
 #define STORAGEENGINE_H_
 
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
+#include "AsyncIO.h"
+#include "LogCodec.h"
+#include "PageFile.h"
 
 class LogMgr; 
 
@@ -24,29 +32,235 @@ struct Page {
     }
 };
 
+/*
+ * A read-only window onto the bytes of a buffered page. The frame it
+ * points into stays pinned, and so cannot be evicted, until the view is
+ * handed back to StorageEngine::unpin(). A write that grows the page
+ * past its current length invalidates the pointer.
+ */
+struct PageView {
+    int page_id;
+    const char* data;
+    int length;
+
+    PageView() {
+        page_id = -1;
+        data = NULL;
+        length = 0;
+    }
+
+    PageView(int new_page_id, const char* new_data, int new_length) {
+        page_id = new_page_id;
+        data = new_data;
+        length = new_length;
+    }
+};
+
+/*
+ * One write of a batch: put bytes on page_id starting from the offset byte.
+ */
+struct WriteOp {
+    int page_id;
+    int offset;
+    std::string bytes;
+
+    WriteOp(int new_page_id, int new_offset, std::string new_bytes) {
+        page_id = new_page_id;
+        offset = new_offset;
+        bytes = new_bytes;
+    }
+};
+
+/*
+ * Volume and time of log I/O. stored_bytes is what reached the log file,
+ * which is less than raw_bytes when log compression is on.
+ */
+struct LogIOStats {
+    unsigned long flushes;
+    unsigned long raw_bytes;
+    unsigned long stored_bytes;
+    double flush_seconds;
+    double read_seconds;
+    unsigned long segments_removed;
+
+    LogIOStats() {
+        segments_removed = 0;
+        flushes = 0;
+        raw_bytes = 0;
+        stored_bytes = 0;
+        flush_seconds = 0;
+        read_seconds = 0;
+    }
+};
+
+/*
+ * A piece of the log in its own file, holding the records with LSNs
+ * first_lsn to last_lsn. The newest segment is the active one.
+ */
+struct LogSegment {
+    int first_lsn;
+    int last_lsn;
+    unsigned long bytes;
+    std::string filename;
+};
+
+/*
+ * Where one log flush, the records with LSNs first_lsn to last_lsn,
+ * lies on disk: length bytes from offset in the segment that starts
+ * at segment_lsn, or in the log file if segment_lsn is -1.
+ */
+struct LogFlushMark {
+    int first_lsn;
+    int last_lsn;
+    int segment_lsn;
+    unsigned long offset;
+    unsigned long length;
+};
+
+struct BufferStats {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+
+    BufferStats() {
+        hits = 0;
+        misses = 0;
+        evictions = 0;
+    }
+};
+
+/*
+ * What the flush controller has done: its checks, the pages it wrote
+ * back, and the restart time it estimated last and at most, with the
+ * log bytes that last estimate would have redone.
+ */
+struct FlushControlStats {
+    unsigned long checks;
+    unsigned long pages_written;
+    unsigned long redo_bytes;
+    double estimate_ms;
+    double max_estimate_ms;
+
+    FlushControlStats() {
+        checks = 0;
+        pages_written = 0;
+        redo_bytes = 0;
+        estimate_ms = 0;
+        max_estimate_ms = 0;
+    }
+};
+
 class StorageEngine {
 
     private:
-        // Memory for records, when crash clear records.
+        // Buffer pool frames, sized once in the constructor so a pinned
+        // frame never moves. When crash, every frame is emptied. With a
+        // page file, a frame's data lives in its aligned I/O frame.
         std::vector<Page> records;
+	std::vector<int> pin_counts; //per frame
+	std::vector<int> resident; //frames holding a page, in load order
+	std::vector<int> free_frames;
+	std::vector<int> page_frame; //page_id -> frame, -1 if not buffered
+	BufferStats buffer_stats;
 	std::vector<Page> onDisk; 
 	int log_sequence_number = 1;
         int master_lsn = -1;
 	//Number of pageWrite calls permitted.
 	//Must be 0 until a crash.
 	int page_writes_permitted = 0;
+	//Log only the changed byte runs of each write.
+	bool diff_logging = false;
+	//Store the log as compressed blocks, one per updateLog call.
+	bool log_compression = false;
+	LogCompressor log_compressor;
+	//Split the log into files of about this many bytes; 0 keeps one file.
+	unsigned long log_segment_bytes = 0;
+	//Move truncated segments aside instead of deleting them.
+	bool log_archiving = false;
+	//Log an end_write record for every dirty page written back.
+	bool page_flush_logging = false;
+	//Have redo apply each page's records in one visit.
+	bool page_sorted_redo = false;
+	//Open for new work right after analysis, recovering pages as they
+	//are asked for. recovery_deferred is whether any recovery is still
+	//left; it gets what was left of the crash's page write budget.
+	bool instant_restart = false;
+	//Redo at restart, but roll the losers back as new work needs.
+	bool background_undo = false;
+	//Chain each update and CLR to the page's previous record.
+	bool page_chain_logging = false;
+	//Let commits return before their records are on disk, forcing the
+	//log once one has waited async_commit_ms or the log tail holds
+	//async_commit_bytes; 0 leaves out that bound.
+	bool async_commit = false;
+	unsigned async_commit_ms = 0;
+	unsigned long async_commit_bytes = 0;
+	//Forces the log at the delay bound when no new work comes in to
+	//do it: commit_flush_lm's oldest async commit is due at
+	//commit_flush_due. It runs under engine_mutex, which every entry
+	//point of StorageEngine and LogMgr holds.
+	std::thread commit_flusher;
+	std::recursive_mutex engine_mutex;
+	std::condition_variable_any commit_flush_wake;
+	LogMgr* commit_flush_lm = NULL;
+	std::chrono::steady_clock::time_point commit_flush_due;
+	bool commit_flusher_stopping = false;
+	//Write back dirty pages, oldest recLSN first, to keep the estimated
+	//restart time under recovery_target_ms; 0 turns it off. flush_rate
+	//is how many pages each check writes back, and restart_bytes_per_sec
+	//how fast the last restart read the log.
+	double recovery_target_ms = 0;
+	unsigned flush_rate = 0;
+	unsigned control_writes = 0;
+	double restart_bytes_per_sec;
+	FlushControlStats flush_control;
+	bool recovery_deferred = false;
+	bool in_deferred_recovery = false;
+	int recovery_writes_permitted = 0;
+	//With a page file, onDisk keeps each page's id and LSN and the
+	//data lives in the file.
+	std::string page_filename;
+	bool page_file_direct = false;
+	PageFile page_file;
+	//Background I/O for log forces and page write-back; NULL when off.
+	AsyncIO* async_io = NULL;
+	std::vector<LogSegment> log_segments; //oldest first
+	//With page chain logging and an uncompressed log, every flush in
+	//LSN order, so a record can be read without the rest of the log.
+	std::vector<LogFlushMark> log_flushes;
+	LogIOStats log_stats;
 	LogMgr* lm_ptr;
 	std::string log_filename;
         std::string output_filename;
 	const unsigned MEMORY_SIZE; //number of pages buffer can hold at once
 	int findPage(int page_id); 
 	void updatePage(int page_id, int offset, std::string text);
+	bool fitsPage(int page_id, size_t length, int offset, size_t len);
+	const char* frameData(int frame);
+	int frameLength(int frame);
+	std::string frameBytes(int frame, int offset, size_t len);
+	void replaceInFrame(int frame, int offset, const std::string& bytes);
 	void flushPage(int page_id);
+	void discardPage(int page_id);
 	void updateLSN(int page_id, int newLSN);
+	void clearBuffer();
+	bool readDiskPage(int page_id, int frame);
+	void writeDiskPage(int frame);
+	unsigned long appendLogBlock(const std::string& filename, const std::string& log_entries);
+	std::string readLogBlocks(const std::string& filename);
+	std::string readLogFile(const std::string& filename, size_t skip = 0);
+	std::string activeSegment(unsigned long incoming, int first_lsn);
+	std::string segmentName(int first_lsn, std::string last);
+	void appendLogAsync(const std::string& filename, const char* log_entries, size_t length);
+	void runDeferredRecovery(int txid, int page_id, unsigned background_pages);
+	unsigned writeBackFrames(const std::vector<int>& frames);
+	void controlFlushing();
+	void runCommitFlusher();
 
     public:
         // Constructor
         StorageEngine();
+        ~StorageEngine();
 
 	/* 
 	 * Starts the storage engine with a database by reading the database
@@ -72,16 +286,293 @@ class StorageEngine {
 	void end_crash(LogMgr* log_mgr_ptr);
 
 	/*
-	 * Appends the given string to the log file on disk.
+	 * With diff logging on, a write is logged as one update record per
+	 * run of bytes it actually changes, and a write that changes nothing
+	 * is not logged or applied at all. Off by default, so the log matches
+	 * the full-image format byte for byte.
+	 */
+	void setDiffLogging(bool enabled);
+
+	/*
+	 * With log compression on, each updateLog call is written as one
+	 * compressed block and getLog reads and decodes the blocks in order,
+	 * one at a time. It still returns the decoded log whole, as recover
+	 * takes it. Must be chosen before anything is logged; off by default.
+	 */
+	void setLogCompression(bool enabled);
+
+	/*
+	 * With page flush logging on, LogMgr logs an end_write record each
+	 * time a dirty page is written back, so analysis can drop the page
+	 * from the dirty page table. Off by default, as the records take
+	 * LSNs and change the log.
+	 */
+	void setPageFlushLogging(bool enabled);
+
+	/*
+	 * With page sorted redo on, recovery groups the redo records by
+	 * page, keeping them in LSN order within a page, and applies each
+	 * page's records in one visit, so a dirty page set larger than the
+	 * buffer pool is not loaded and evicted over and over. Off by
+	 * default, as under a crash's page write budget it changes which
+	 * writes are redone before the budget runs out.
+	 */
+	void setPageSortedRedo(bool enabled);
+	bool pageSortedRedo();
+
+	/*
+	 * With instant restart on, crash() returns once analysis is done
+	 * and the engine takes new work straight away. A page is brought up
+	 * to date, its records redone and the losers that wrote it rolled
+	 * back, the first time it is asked for, and each write, read or
+	 * abort also recovers one more page, as background work; end()
+	 * finishes whatever is left. That work runs in the caller's thread,
+	 * not one of its own, so the log and the database come out the same
+	 * on every run, but an engine given no new work recovers nothing
+	 * until end(). This recovery uses what the crash's page write
+	 * budget has left. In a sequence such as crash {5 2}, each crash but
+	 * the last comes before its restart has written anything, so only
+	 * the last crash's budget is ever spent. Off by default.
+	 */
+	void setInstantRestart(bool enabled);
+	bool instantRestart();
+
+	/*
+	 * With background undo on, crash() redoes the log as usual but does
+	 * not wait for the losers to be rolled back. There being no lock
+	 * manager, a loser holds the pages it wrote: the first write, read
+	 * or abort to reach one of them rolls the loser back first, with
+	 * CLRs as undo writes them, and each write, read or abort also
+	 * rolls back part of what is left, as background work; end()
+	 * finishes it. As with instant restart, that work runs in the
+	 * caller's thread, so the log stays the same from run to run and an
+	 * idle engine undoes nothing until end(). Each crash of a sequence
+	 * such as crash {5 2} but the last stops its restart after redo,
+	 * and the next restart finds the same losers again. Off by default.
+	 */
+	void setBackgroundUndo(bool enabled);
+	bool backgroundUndo();
+
+	/*
+	 * With page chain logging on, each update and CLR also records the
+	 * LSN of the previous one on its page, so that repairPage can find
+	 * a page's records without reading the rest of the log. Off by
+	 * default, as it adds a field to those records.
+	 */
+	void setPageChainLogging(bool enabled);
+	bool pageChainLogging();
+
+	/*
+	 * Rebuilds a page, as for a corrupt buffered copy, from its image on
+	 * disk and the records its page chain leads to, dropping the copy in
+	 * the buffer unwritten. Needs page chain logging. Returns false and
+	 * leaves the page alone if the page does not exist, is pinned, or
+	 * its chain does not reach back to the disk image.
+	 */
+	bool repairPage(int page_id);
+
+	/*
+	 * Overwrites the buffered copy of a page with '#', unlogged, as a
+	 * stand-in for a frame gone bad, so testcases can check that
+	 * repairPage brings it back. Returns false if the page is not
+	 * buffered or is pinned.
+	 */
+	bool damagePage(int page_id);
+
+	/*
+	 * With async commit on, LogMgr::commit logs the commit record and
+	 * returns without forcing the log, trading the last commits before
+	 * a crash for fewer flushes. The log is forced once the oldest
+	 * commit not yet on disk has waited max_delay_ms, by a background
+	 * thread if no new work comes in first, or once the log tail has
+	 * grown to max_bytes, which only new work can make it do; end()
+	 * forces whatever commits are left. 0 leaves out a bound.
+	 * Off by default.
+	 */
+	void setAsyncCommit(bool enabled, unsigned max_delay_ms, unsigned long max_bytes);
+	bool asyncCommit();
+	unsigned asyncCommitDelayMs();
+	unsigned long asyncCommitBytes();
+
+	/*
+	 * For LogMgr's async commits: has the flusher thread call
+	 * lm->flushDueCommits() at due, starting the thread the first
+	 * time, or stops it waiting on lm.
+	 */
+	void scheduleCommitFlush(LogMgr* lm, std::chrono::steady_clock::time_point due);
+	void cancelCommitFlush(LogMgr* lm);
+
+	/*
+	 * Held by each entry point of StorageEngine and LogMgr, so the
+	 * commit flusher only runs between operations.
+	 */
+	std::recursive_mutex& engineMutex();
+
+	/*
+	 * With a recovery time target, every few writes the engine estimates
+	 * how long a restart would take: the log on disk from where its
+	 * redo would start on, at the rate the last restart read the log.
+	 * While the estimate is over target_ms the number of pages written
+	 * back per check, oldest recLSN first, doubles; under half the
+	 * target it halves, down to none. A restart only sees the pages
+	 * written back through the next checkpoint, or at once with page
+	 * flush logging, so without it the estimate stays at the last
+	 * checkpoint's oldest recLSN until another checkpoint is taken.
+	 * 0, the default, turns it off.
+	 */
+	void setRecoveryTarget(double target_ms);
+	double recoveryTargetMs();
+	FlushControlStats getFlushControlStats();
+
+	/*
+	 * After an instant restart or with background undo, rolls back
+	 * txid first if it is a loser
+	 * not yet rolled back, then recovers one more page. write,
+	 * writeBatch, readView and abort do this themselves; LogMgr calls
+	 * it before logging a commit.
+	 */
+	void recoverDeferred(int txid);
+
+	/*
+	 * Brings page_id up to date if its recovery was deferred, under the
+	 * crash's leftover budget whoever asks. Returns false only if this
+	 * is part of deferred recovery already and that budget runs out.
+	 */
+	bool recoverDeferredPage(int page_id);
+
+	/*
+	 * Keeps the pages in filename, one 4KiB slot each, instead of in
+	 * memory, reading and writing them through aligned frames of the
+	 * buffer pool. With direct, the file is opened with O_DIRECT, so
+	 * the buffer pool is the only cache of it. Must be called before
+	 * start().
+	 */
+	void setPageFile(const std::string& filename, bool direct);
+
+	// Whether the page file is open with O_DIRECT.
+	bool pageFileDirect();
+
+	/*
+	 * With async I/O on, each log flush is written and fdatasync'd
+	 * through an AsyncIO queue (io_uring if use_uring and the kernel
+	 * has it, else a thread pool), and so are page file reads and
+	 * write-backs. writeBackDirtyPages forces the log once for all its
+	 * pages and puts their writes in flight at once, and pinPages
+	 * does the same for the reads of the pages it loads. Compressed
+	 * logs are still written by the calling thread. Off by default.
+	 */
+	void setAsyncIO(bool enabled, bool use_uring);
+
+	// "io_uring", "threads", or "off".
+	const char* asyncIOBackend();
+	bool pageFlushLogging();
+
+	/*
+	 * With bytes > 0 the log is written as a series of segment files of
+	 * about that size, named by the LSN range they hold, and getLog reads
+	 * the segments that remain. truncateLog drops old segments; archive
+	 * moves them into output/log/archive instead of deleting them.
+	 * Must be chosen before anything is logged; 0 (one file) by default.
+	 */
+	void setLogSegmentBytes(unsigned long bytes, bool archive);
+
+	/*
+	 * Removes the sealed log segments that hold only records with LSNs
+	 * below horizon_lsn. Does nothing when the log is a single file.
+	 */
+	void truncateLog(int horizon_lsn);
+
+	/*
+	 * Log bytes and time spent in updateLog and getLog since start.
 	 */
-        void updateLog(std::string log_entries);
+	LogIOStats getLogIOStats();
+
+	/*
+	 * Appends the given string to the log file on disk. first_lsn and
+	 * last_lsn are the LSNs of the first and last record in it, if known.
+	 */
+        void updateLog(const std::string& log_entries, int first_lsn = -1, int last_lsn = -1);
+
+	/*
+	 * The same for the length bytes at log_entries, so a caller can
+	 * flush from a buffer it reuses.
+	 */
+        void updateLog(const char* log_entries, size_t length, int first_lsn = -1, int last_lsn = -1);
 
 	/*
 	 * Write to a page starting from the offset byte with the particular
-	 * transaction specified by txid.
+	 * transaction specified by txid.  The write is refused if the
+	 * page can't be brought into a frame because every frame is pinned,
+	 * or if it starts past the end of the page or, with a page file,
+	 * would outgrow the page's slot.
 	 */
         void write(int txid, int page_id, int offset, std::string input);
 
+	/*
+	 * Applies several writes for transaction txid as one group. The writes
+	 * are ordered by page (keeping their given order within a page), every
+	 * page is pinned once for the whole batch to take its before-images
+	 * and apply its writes, and all update records are appended to the
+	 * log tail with one block of LSNs. If any page does not exist, the
+	 * pages cannot all be pinned at once, or any write would be refused
+	 * by write, nothing is logged or written.
+	 */
+	void writeBatch(int txid, std::vector<WriteOp> ops);
+
+	/*
+	 * Returns len bytes of a page starting from the offset byte, as seen
+	 * by transaction txid. The result is cut short at the end of the page
+	 * and is empty if the page does not exist.
+	 */
+	std::string read(int txid, int page_id, int offset, int len);
+
+	/*
+	 * Like read, but returns a view into the buffer pool frame instead of
+	 * a copy. The frame stays pinned until the view is passed to unpin().
+	 * If the page does not exist, or every frame is pinned, the view's
+	 * data is NULL and nothing is pinned.
+	 */
+	PageView readView(int txid, int page_id, int offset, int len);
+	void unpin(const PageView& view);
+
+	/*
+	 * Pins a page in the buffer pool, loading it if needed, so it will not
+	 * be evicted until a matching unpinPage. Pins nest.
+	 * Returns false if the page does not exist or no frame is free.
+	 */
+	bool pinPage(int page_id);
+	void unpinPage(int page_id);
+
+	/*
+	 * Pins page_ids in order, as pinPage would each, but with async
+	 * I/O and a page file the pages not buffered are loaded together:
+	 * the dirty pages evicted for them are written back as one batch,
+	 * then their reads are issued as another, each drained once. Stops
+	 * at the first page that does not exist, finds no frame or cannot be
+	 * read, and
+	 * returns how many of page_ids were pinned. unpinPages unpins the
+	 * first count of page_ids.
+	 */
+	unsigned pinPages(const std::vector<int>& page_ids);
+	void unpinPages(const std::vector<int>& page_ids, unsigned count);
+
+	// Whether a page is in the buffer pool now.
+	bool isBuffered(int page_id);
+
+	/*
+	 * Hit, miss and eviction counts of the buffer pool since start or the
+	 * last resetBufferStats.
+	 */
+	BufferStats getBufferStats();
+	void resetBufferStats();
+
+	/*
+	 * Writes back up to max_pages dirty pages, in load order, leaving
+	 * them buffered and clean; the log is forced ahead of each as for
+	 * an eviction. Returns the number of pages written.
+	 */
+	unsigned writeBackDirtyPages(unsigned max_pages);
+
 	/*
 	 * Sets the number of page writes allowed for this abort,
 	 * then calls LogMgr's abort function. 
@@ -93,6 +584,11 @@ class StorageEngine {
 	 */
         int nextLSN();
 
+	/*
+	 * Reserves count consecutive LSNs and returns the first of them.
+	 */
+	int nextLSNs(int count);
+
 	/*
 	 * Writes lsn to a particular location on the disk.
 	 * Returns true on success.
@@ -107,10 +603,18 @@ class StorageEngine {
         
 
 	/* 
-	 * Returns the LSN of a page.
+	 * Returns the LSN of a page, or -1 if it can't be brought
+	 * into a frame.
 	 */
         int getLSN(int page_id);
 
+	/*
+	 * Fills lsns with the LSN of each page in page_ids, from its frame
+	 * if it is buffered and from disk if not, without loading or
+	 * evicting anything. A page that does not exist gets -1.
+	 */
+	void getLSNs(const std::vector<int>& page_ids, std::vector<int>& lsns);
+
 	/*
 	 * Return the filename of output file
 	 */
@@ -121,9 +625,24 @@ class StorageEngine {
 	 */
         std::string getLog();
 
+	/*
+	 * The same without its first skip bytes. A plain log file is read
+	 * from there on.
+	 */
+        std::string getLog(size_t skip);
+
+	/*
+	 * Reads into text the log flush holding lsn, seeking to it in its
+	 * file. Returns false if no flush on disk is known to hold it: the
+	 * log is compressed, page chain logging was off when it was
+	 * written, or its segment has been truncated.
+	 */
+        bool readLogFlush(int lsn, std::string& text);
+
 	/*
 	* Writes to a page in memory, if allowed.  
-	* If page_writes_permitted <= 0, this just 
+	* If page_writes_permitted <= 0, or the page
+	* can't be brought into a frame, this just 
 	* returns false and doesn't write the page. 
 	*/
         bool pageWrite(int page_id, int offset, std::string text, int lsn);
@@ -0,0 +1,155 @@
+#include "Testcase.h"
+#include "StorageEngine.h"
+#include "Trace.h"
+#include "../StudentComponent/LogMgr.h"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+using namespace std;
+
+const char* DRIVER_OPTIONS_USAGE =
+  "[--diff-log] [--compress-log] [--log-segment-bytes n [--archive-log]]"
+  " [--log-page-flushes] [--page-sorted-redo] [--instant-restart]"
+  " [--background-undo] [--page-chain-log] [--async-commit ms [--async-commit-bytes n]]"
+  " [--recovery-target-ms t] [--page-file file [--direct-io]] [--async-io uring|threads]"
+  " [--coroutines [--group-commit n]] [--write-batch] [--trace file]";
+
+bool parseDriverOption(int argc, char *argv[], int& i, DriverOptions& options) {
+  string arg = argv[i];
+  if (arg == "--diff-log") {
+    options.diff_log = true;
+  } else if (arg == "--compress-log") {
+    options.compress_log = true;
+  } else if (arg == "--log-segment-bytes" && i + 1 < argc) {
+    options.log_segment_bytes = strtoul(argv[++i], NULL, 10);
+  } else if (arg == "--archive-log") {
+    options.archive_log = true;
+  } else if (arg == "--log-page-flushes") {
+    options.log_page_flushes = true;
+  } else if (arg == "--page-sorted-redo") {
+    options.page_sorted_redo = true;
+  } else if (arg == "--instant-restart") {
+    options.instant_restart = true;
+  } else if (arg == "--background-undo") {
+    options.background_undo = true;
+  } else if (arg == "--page-chain-log") {
+    options.page_chain_log = true;
+  } else if (arg == "--async-commit" && i + 1 < argc) {
+    options.async_commit = true;
+    options.async_commit_ms = (unsigned)strtoul(argv[++i], NULL, 10);
+  } else if (arg == "--async-commit-bytes" && i + 1 < argc) {
+    options.async_commit_bytes = strtoul(argv[++i], NULL, 10);
+  } else if (arg == "--recovery-target-ms" && i + 1 < argc) {
+    options.recovery_target_ms = atof(argv[++i]);
+  } else if (arg == "--page-file" && i + 1 < argc) {
+    options.page_file = argv[++i];
+  } else if (arg == "--direct-io") {
+    options.direct_io = true;
+  } else if (arg == "--async-io" && i + 1 < argc) {
+    options.async_io = argv[++i];
+  } else if (arg == "--coroutines") {
+    options.coroutines = true;
+  } else if (arg == "--group-commit" && i + 1 < argc) {
+    options.group_commit = max(1, atoi(argv[++i]));
+  } else if (arg == "--write-batch") {
+    options.write_batch = true;
+  } else if (arg == "--trace" && i + 1 < argc) {
+    options.trace_file = argv[++i];
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void applyDriverOptions(const DriverOptions& options, StorageEngine& se) {
+  se.setDiffLogging(options.diff_log);
+  se.setLogCompression(options.compress_log);
+  se.setLogSegmentBytes(options.log_segment_bytes, options.archive_log);
+  se.setPageFlushLogging(options.log_page_flushes);
+  se.setPageSortedRedo(options.page_sorted_redo);
+  se.setInstantRestart(options.instant_restart);
+  se.setBackgroundUndo(options.background_undo);
+  se.setPageChainLogging(options.page_chain_log);
+  se.setAsyncCommit(options.async_commit, options.async_commit_ms, options.async_commit_bytes);
+  se.setRecoveryTarget(options.recovery_target_ms);
+  if (!options.page_file.empty())
+    se.setPageFile(options.page_file, options.direct_io);
+  if (!options.async_io.empty())
+    se.setAsyncIO(true, options.async_io == "uring");
+  if (!options.trace_file.empty() && !trace::enabled) //engines of one run share a trace
+    trace::start(options.trace_file);
+}
+
+TestcaseOp parseTestcaseLine(const string& line) {
+  TestcaseOp op;
+  stringstream ss(line);
+  string first;
+  ss >> first;
+  // if it looks like <crash {5 2}>, the safe writes are {5, 2}
+  if (first == "crash") {
+    op.type = OP_CRASH;
+    string intvector;
+    while(ss >> intvector) {
+      if (intvector[0] == '{') 
+	intvector.erase(0,1);
+      if (!intvector.empty() && intvector[intvector.length()-1] == '}')
+	intvector.erase(intvector.length()-1,1);
+      stringstream ss2(intvector);
+      int i;
+      while (ss2 >> i) {
+	op.safe_writes.push_back(i);
+      }
+    }
+  }
+  else if (first == "end") {
+    op.type = OP_END;
+  } 
+  else if (first == "checkpoint"){
+    op.type = OP_CHECKPOINT;
+  }
+  //<damage 7>, <repair 7>
+  else if (first == "damage" || first == "repair"){
+    op.type = first == "damage" ? OP_DAMAGE : OP_REPAIR;
+    ss >> op.page_id;
+  }
+  else{
+    op.txid = atoi(first.c_str());
+    string typechoose;
+    ss >> typechoose;
+    //<1 commit>
+    if (typechoose == "commit") {
+      op.type = OP_COMMIT;
+    }
+    //<1 abort 5>, or <1 abort> for no limit
+    else if (typechoose == "abort"){
+      op.type = OP_ABORT;
+      if (!(ss >> op.pages_allowed))
+	op.pages_allowed = UNLIMITED_PAGE_WRITES;
+    }
+    //<1 write 34 27 "ABC">
+    else if (typechoose == "write"){
+      op.type = OP_WRITE;
+      ss >> op.page_id >> op.offset >> op.text;
+    }
+  }
+  return op;
+}
+
+LogMgr* crash(vector<int> safe_writes, StorageEngine* se) {
+  LogMgr* newLm = NULL;
+  for (unsigned i = 0; i < safe_writes.size(); ++i)
+    {
+      LogMgr* interrupted = newLm;
+      newLm = new LogMgr();
+      newLm->setStorageEngine(se);
+      if (interrupted)
+	{
+	  //only the log the interrupted recovery wrote needs reading again
+	  newLm->resumeRecovery(*interrupted);
+	  delete interrupted;
+	}
+      se->crash(safe_writes[i], newLm);
+    }
+    return newLm;
+}
@@ -0,0 +1,132 @@
+#ifndef TESTCASE_H_
+#define TESTCASE_H_
+
+#include <climits>
+#include <string>
+#include <vector>
+
+class StorageEngine;
+class LogMgr;
+
+/*
+ * Pieces of the testcase driver shared by main.o and the benchmarks:
+ * engine options from the command line, parsing of testcase lines, and
+ * running a crash sequence.
+ */
+
+/*
+ * Engine settings taken from the command line after the testcase name.
+ * With write_batch, main.o hands each run of consecutive writes by one
+ * transaction to StorageEngine::writeBatch as a single batch.
+ */
+struct DriverOptions {
+  bool diff_log;
+  bool compress_log;
+  unsigned long log_segment_bytes;
+  bool archive_log;
+  bool log_page_flushes;
+  bool page_sorted_redo;
+  bool instant_restart;
+  bool background_undo;
+  bool page_chain_log;
+  bool async_commit;
+  unsigned async_commit_ms;
+  unsigned long async_commit_bytes;
+  double recovery_target_ms;
+  std::string page_file;
+  bool direct_io;
+  std::string async_io;
+  bool coroutines;
+  unsigned group_commit;
+  bool write_batch;
+  std::string trace_file;
+
+  DriverOptions() {
+    diff_log = false;
+    compress_log = false;
+    log_segment_bytes = 0;
+    archive_log = false;
+    log_page_flushes = false;
+    page_sorted_redo = false;
+    instant_restart = false;
+    background_undo = false;
+    page_chain_log = false;
+    async_commit = false;
+    async_commit_ms = 0;
+    async_commit_bytes = 0;
+    recovery_target_ms = 0;
+    direct_io = false;
+    coroutines = false;
+    group_commit = 8;
+    write_batch = false;
+  }
+};
+
+// Usage text for the options parseDriverOption understands.
+extern const char* DRIVER_OPTIONS_USAGE;
+
+/*
+ * If argv[i] is a driver option, records it in options, advances i past
+ * any value it takes and returns true.
+ */
+bool parseDriverOption(int argc, char *argv[], int& i, DriverOptions& options);
+
+/*
+ * Applies options to an engine before start().
+ */
+void applyDriverOptions(const DriverOptions& options, StorageEngine& se);
+
+enum TestcaseOpType {OP_WRITE, OP_COMMIT, OP_ABORT, OP_CHECKPOINT, OP_CRASH, OP_END,
+                     OP_DAMAGE, OP_REPAIR, OP_NONE};
+
+// Pages an abort may write when the testcase line does not say.
+const int UNLIMITED_PAGE_WRITES = INT_MAX;
+
+/*
+ * One line of a testcase:
+ *   <txid> write <page_id> <offset> <text>
+ *   <txid> commit
+ *   <txid> abort [pages_allowed]
+ *   checkpoint
+ *   crash {<safe_writes> ...}
+ *   damage <page_id>
+ *   repair <page_id>
+ *   end
+ * damage and repair call StorageEngine::damagePage and repairPage.
+ */
+struct TestcaseOp {
+  TestcaseOpType type;
+  int txid;
+  int page_id;
+  int offset;
+  std::string text;
+  int pages_allowed;
+  std::vector<int> safe_writes;
+
+  TestcaseOp() {
+    type = OP_NONE;
+    txid = 0;
+    page_id = 0;
+    offset = 0;
+    pages_allowed = UNLIMITED_PAGE_WRITES;
+  }
+};
+
+/*
+ * Parses one testcase line. Lines that are not understood come back as
+ * OP_NONE and are skipped by the driver.
+ */
+TestcaseOp parseTestcaseLine(const std::string& line);
+
+/*
+ * crash(vector<int> safe_writes, StorageEngine* se)
+ * For each num in safe_writes:
+ * Destroys the running LogMgr instance
+ * and replaces it with another LogMgr.
+ * Calls se->crash(num, LogMgr).
+ * Each LogMgr after the first resumes the recovery its crash
+ * interrupted, so it only parses and analyzes the log written since.
+ */
+LogMgr* crash(std::vector<int> safe_writes, StorageEngine* se);
+
+#endif
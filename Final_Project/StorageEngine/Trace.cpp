@@ -0,0 +1,90 @@
+#include "Trace.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+namespace trace {
+
+struct Event {
+  const char* name;
+  char phase;
+  double ts;
+  double dur;
+  int tid;
+  string args;
+};
+
+bool enabled = false;
+
+static string filename;
+static chrono::steady_clock::time_point epoch;
+static mutex lock;
+static vector<Event> events;
+
+// Small thread ids, in order of each thread's first event.
+static int threadId() {
+  static atomic<int> next(1);
+  static thread_local int id = next++;
+  return id;
+}
+
+static void record(const char* name, char phase, double ts, double dur, const string& args) {
+  Event e;
+  e.name = name;
+  e.phase = phase;
+  e.ts = ts;
+  e.dur = dur;
+  e.tid = threadId();
+  e.args = args;
+  lock_guard<mutex> guard(lock);
+  events.push_back(e);
+}
+
+void start(const string& new_filename) {
+  lock_guard<mutex> guard(lock);
+  filename = new_filename;
+  events.clear();
+  epoch = chrono::steady_clock::now();
+  enabled = true;
+}
+
+void finish() {
+  if (!enabled)
+    return;
+  enabled = false;
+  lock_guard<mutex> guard(lock);
+  ofstream out(filename);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  for (unsigned i = 0; i < events.size(); ++i) {
+    const Event& e = events[i];
+    out << "{\"name\": \"" << e.name << "\", \"ph\": \"" << e.phase
+	<< "\", \"ts\": " << fixed << e.ts;
+    if (e.phase == 'X')
+      out << ", \"dur\": " << e.dur;
+    else
+      out << ", \"s\": \"t\"";
+    out << ", \"pid\": 1, \"tid\": " << e.tid
+	<< ", \"args\": {" << e.args << "}}"
+	<< (i + 1 < events.size() ? ",\n" : "\n");
+  }
+  out << "]}\n";
+  events.clear();
+}
+
+double now() {
+  return chrono::duration<double, micro>(chrono::steady_clock::now() - epoch).count();
+}
+
+void complete(const char* name, double ts, double dur, const string& args) {
+  record(name, 'X', ts, dur, args);
+}
+
+void instant(const char* name, const string& args) {
+  record(name, 'i', now(), 0, args);
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <string>
+
+/*
+ * Timeline of a run in Chrome trace_event JSON, for chrome://tracing or
+ * Perfetto. Off unless trace::start() is called (main.o --trace file);
+ * while off, a TraceScope costs one test of a flag.
+ */
+namespace trace {
+
+extern bool enabled;
+
+// Starts recording events, to be written to filename by finish().
+void start(const std::string& filename);
+// Writes the events recorded so far and stops recording.
+void finish();
+
+// Microseconds since start().
+double now();
+// A complete ("X") event. args is the body of a JSON object, or "".
+void complete(const char* name, double ts, double dur, const std::string& args);
+// An instant ("i") event.
+void instant(const char* name, const std::string& args);
+
+}
+
+/*
+ * Records a complete event from its construction to the end of the 
+ * enclosing block, with any numeric args added on the way.
+ */
+class TraceScope {
+ public:
+  explicit TraceScope(const char* name) : name(name), recording(trace::enabled) {
+    if (recording)
+      start = trace::now();
+  }
+
+  ~TraceScope() {
+    if (recording)
+      trace::complete(name, start, trace::now() - start, args);
+  }
+
+  void arg(const char* key, long value) {
+    if (!recording)
+      return;
+    if (!args.empty())
+      args += ", ";
+    args += "\"";
+    args += key;
+    args += "\": ";
+    args += std::to_string(value);
+  }
+
+ private:
+  const char* name;
+  bool recording;
+  double start;
+  std::string args;
+
+  TraceScope(const TraceScope&);
+  TraceScope& operator=(const TraceScope&);
+};
+
+#endif
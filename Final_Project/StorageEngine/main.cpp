@@ -1,4 +1,7 @@
+#include "CoDriver.h"
 #include "StorageEngine.h"
+#include "Testcase.h"
+#include "Trace.h"
 #include "../StudentComponent/LogMgr.h"
 #include <vector>
 #include <iostream>
@@ -8,31 +11,12 @@
 
 using namespace std;
 
-/*
- * crash(vector<int> safe_writes, StorageEngine* se)
- * For each num in safe_writes:
- * Destroys the running LogMgr instance
- * and replaces it with another LogMgr.
- * Calls se->crash(num, LogMgr).
- */
-LogMgr* crash(vector<int> safe_writes, StorageEngine* se) {
-  LogMgr* newLm = NULL;
-  for (unsigned i = 0; i < safe_writes.size(); ++i)
-    {
-      if (newLm)
-	delete newLm;
-      newLm = new LogMgr();
-      newLm->setStorageEngine(se);
-      se->crash(safe_writes[i], newLm);
-    }
-    return newLm;
-}
-
 // Assumption: 'correct' folder and student submission's folder has already be created.
 // Assumption: code will run in root eecs484 folder
-void runTestcase(string filename) {
+void runTestcase(string filename, const DriverOptions& options) {
   //Create an instance of StorageEngine called se.
   StorageEngine se;
+  applyDriverOptions(options, se);
   //Create an instance of LogMgr called lm.
   LogMgr* lm = new LogMgr();
   lm->setStorageEngine(&se);
@@ -47,74 +31,82 @@ void runTestcase(string filename) {
   //for the remaining lines in testcase:
   string contents;
   getline(myfile, contents);
+  //with --write-batch, the run of writes gathered so far
+  vector<WriteOp> batch;
+  int batch_txid = 0;
   
   while (contents != ""){  
-    stringstream ss(contents);
-    string ifcrash;
-    ss >> ifcrash;
+    TestcaseOp op = parseTestcaseLine(contents);
+    if (!batch.empty() && (op.type != OP_WRITE || op.txid != batch_txid)) {
+      se.writeBatch(batch_txid, batch);
+      batch.clear();
+    }
     // if it looks like <crash {5 2}>, call crash({5,2}), where {5, 2} is a vector of ints.
-    if (ifcrash == "crash") {
-      string intvector;
-      vector<int> crashint;
-      while(ss >> intvector) {
-	if (intvector[0] == '{') 
-	  intvector.erase(0,1);
-	unsigned int len = intvector.length();
-	if (intvector[len-1] == '}')
-	  intvector.erase(len-1,1);
-	stringstream ss2(intvector);
-	int i;
-	while (ss2 >> i) {
-	  crashint.push_back(i);
-	}
-      }
-      lm=crash(crashint, &se);//return pointer?
+    if (op.type == OP_CRASH) {
+      lm=crash(op.safe_writes, &se);//return pointer?
       se.end_crash(lm);
     }
-    else if (ifcrash == "end") {
+    else if (op.type == OP_END) {
       se.end(se.getOutputFileName());
       break;
     } 
-    else if (ifcrash == "checkpoint"){
+    else if (op.type == OP_CHECKPOINT){
 	lm->checkpoint();
     }
-    else{
-      stringstream ss(contents);
-      int firstnum;
-      ss >> firstnum;
-      string typechoose;
-      ss >>typechoose;
-      //if it looks like <1 commit>, call lm.commit(1)
-      if (typechoose == "commit") {
-	lm->commit(firstnum);
-      }
-      //if it looks like <1 abort 5>, call se.abort(1, 5)
-      else if (typechoose == "abort"){
-	int pages_allowed;
-	ss >> pages_allowed;
-	se.abort(firstnum, pages_allowed);
-      }
-      //if it looks like <1 write 34 27 "ABC">,
-      //Call se.write(1, 34, 27, "ABC")
-      else if (typechoose == "write"){
-	int a,b;
-	string c;
-	ss >> a >> b >> c;
-	se.write(firstnum,a,b,c);
-      }
+    else if (op.type == OP_DAMAGE){
+      if (!se.damagePage(op.page_id))
+	cerr << "page " << op.page_id << " is not in the buffer to damage" << endl;
+    }
+    else if (op.type == OP_REPAIR){
+      if (!se.repairPage(op.page_id))
+	cerr << "could not repair page " << op.page_id << endl;
+    }
+    //if it looks like <1 commit>, call lm.commit(1)
+    else if (op.type == OP_COMMIT) {
+      lm->commit(op.txid);
+    }
+    //if it looks like <1 abort 5>, call se.abort(1, 5)
+    else if (op.type == OP_ABORT){
+      se.abort(op.txid, op.pages_allowed);
+    }
+    //if it looks like <1 write 34 27 "ABC">,
+    //Call se.write(1, 34, 27, "ABC")
+    else if (op.type == OP_WRITE && options.write_batch){
+      batch_txid = op.txid;
+      batch.push_back(WriteOp(op.page_id, op.offset, op.text));
+    }
+    else if (op.type == OP_WRITE){
+      se.write(op.txid, op.page_id, op.offset, op.text);
     }
     getline(myfile, contents);
   }
+  if (!batch.empty())
+    se.writeBatch(batch_txid, batch);
   delete lm; lm = NULL;
   myfile.close();
 }
 
 /*
  * Main function for running the database recovery simulator.
- * 
+ * usage: main.o testcase [options]; see DRIVER_OPTIONS_USAGE
  */
 int main (int argc, char *argv[]) {
-    runTestcase(argv[1]);
+    if (argc < 2) {
+      cerr << "usage: " << argv[0] << " testcase " << DRIVER_OPTIONS_USAGE << endl;
+      return 1;
+    }
+    DriverOptions options;
+    for (int i = 2; i < argc; ++i) {
+      if (!parseDriverOption(argc, argv, i, options)) {
+        cerr << "unknown option " << argv[i] << endl;
+        return 1;
+      }
+    }
+    if (options.coroutines)
+      runTestcaseCoroutines(argv[1], options);
+    else
+      runTestcase(argv[1], options);
+    trace::finish();
 
     return 0;
 }
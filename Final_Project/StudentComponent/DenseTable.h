@@ -0,0 +1,121 @@
+#ifndef DENSETABLE_H_
+#define DENSETABLE_H_
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+///////////////////  DenseTable  ///////////////////
+
+/*
+ * A table from non-negative ids (txids, page ids) to values, kept in one
+ * vector indexed by id. A lookup is a single index, an entry needs no
+ * allocation of its own, and iteration runs in id order like a map's,
+ * so the checkpoint tables come out the same. Memory grows with the
+ * largest id stored, which suits the small dense ids of this engine;
+ * ids above MAX_ID are refused so that one stray id cannot allocate a
+ * slot for every id below it.
+ *
+ * Only the subset of std::map the LogMgr uses is provided. Iterators
+ * point at (id, value) pairs; they stay valid until an id past the end
+ * of the table is added.
+ */
+template <typename V>
+class DenseTable {
+ public:
+  typedef std::pair<int, V> Entry;
+
+  enum { MAX_ID = (1 << 22) - 1 };
+
+  // Whether id can be stored: 0 to MAX_ID.
+  static bool validId(int id) { return id >= 0 && id <= MAX_ID; }
+
+  template <typename E>
+  class Iter {
+   public:
+    Iter(E* at, E* stop) : cur(at), last(stop) { skipFree(); }
+    E& operator*() const { return *cur; }
+    E* operator->() const { return cur; }
+    Iter& operator++() { ++cur; skipFree(); return *this; }
+    Iter operator++(int) { Iter old = *this; ++*this; return old; }
+    bool operator==(const Iter& rhs) const { return cur == rhs.cur; }
+    bool operator!=(const Iter& rhs) const { return cur != rhs.cur; }
+   private:
+    E* cur;
+    E* last;
+    void skipFree() { while (cur != last && cur->first == FREE) ++cur; }
+  };
+  typedef Iter<Entry> iterator;
+  typedef Iter<const Entry> const_iterator;
+
+  DenseTable() : used(0) {}
+
+  iterator begin() { return iterator(slots.data(), slots.data() + slots.size()); }
+  iterator end() { return iterator(slots.data() + slots.size(), slots.data() + slots.size()); }
+  const_iterator begin() const { return const_iterator(slots.data(), slots.data() + slots.size()); }
+  const_iterator end() const { return const_iterator(slots.data() + slots.size(), slots.data() + slots.size()); }
+
+  size_t size() const { return used; }
+  bool empty() const { return used == 0; }
+
+  iterator find(int id) {
+    if (!contains(id))
+      return end();
+    return iterator(slots.data() + id, slots.data() + slots.size());
+  }
+
+  bool contains(int id) const {
+    return id >= 0 && id < (int)slots.size() && slots[id].first != FREE;
+  }
+
+  // The value of id, added value-initialized if absent. id must be valid.
+  V& operator[](int id) {
+    assert(validId(id));
+    insert(id, V());
+    return slots[id].second;
+  }
+
+  // Adds id with value unless id is already there, or not valid.
+  // Returns whether it was added.
+  bool insert(int id, const V& value) {
+    if (!validId(id))
+      return false;
+    if (id >= (int)slots.size())
+      slots.resize(id + 1, Entry(FREE, V()));
+    if (slots[id].first != FREE)
+      return false;
+    slots[id] = Entry(id, value);
+    ++used;
+    return true;
+  }
+
+  size_t erase(int id) {
+    if (!contains(id))
+      return 0;
+    slots[id] = Entry(FREE, V()); // drops what the value held
+    --used;
+    return 1;
+  }
+
+  // Empties the table, keeping its memory for the next fill.
+  void clear() {
+    slots.clear();
+    used = 0;
+  }
+
+  void swap(DenseTable& rhs) {
+    slots.swap(rhs.slots);
+    std::swap(used, rhs.used);
+  }
+
+ private:
+  enum { FREE = -1 };         // the id of a slot with no entry
+
+  std::vector<Entry> slots;   // slots[id] holds id's entry
+  size_t used;
+};
+
+///////////////////  End DenseTable  ///////////////////
+
+#endif
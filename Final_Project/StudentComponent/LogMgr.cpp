@@ -1,4 +1,12 @@
 #include "LogMgr.h"
+#include "../StorageEngine/Metrics.h"
+#include "../StorageEngine/Trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
 #include <queue>
 #include <sstream>
 
@@ -11,7 +19,8 @@ using namespace std;
  */
 int LogMgr::getLastLSN(int txnum)
 {
-  if ( tx_table.find(txnum) == tx_table.end() )
+  auto it = tx_table.find(txnum);
+  if ( it == tx_table.end() )
     {
       // not found
       return NULL_LSN;
@@ -19,7 +28,7 @@ int LogMgr::getLastLSN(int txnum)
   else 
     {
       // found
-      return tx_table[txnum].lastLSN;
+      return it->second.lastLSN;
     }
 }
 
@@ -44,36 +53,56 @@ void LogMgr::setLastLSN(int txnum, int lsn)
  */
 void LogMgr::flushLogTail(int maxLSN)
 {
-  string logtoflush = "";
+  flush_buffer.clear();
+  int firstLsn = NULL_LSN, lastLsn = NULL_LSN;
   auto it = logtail.begin();
-  while(it != logtail.end())
+  while( it != logtail.end() && (*it)->getLSN() <= maxLSN )
     {
-      if ( (*it)->getLSN() > maxLSN )
+      if ( firstLsn == NULL_LSN )
 	{
-	  break;
-	}
-      else
-	{
-	  logtoflush.append( (*it)->toString() );
-	  it = logtail.erase(it);
+	  firstLsn = (*it)->getLSN();
 	}
+      lastLsn = (*it)->getLSN();
+      (*it)->serializeInto(flush_buffer);
+      it++;
+    }
+  size_t flushed = it - logtail.begin();
+  if ( flushed < tail_measured )
+    {
+      tail_measured -= flushed;
+      tail_bytes -= flush_buffer.length();
+    }
+  else
+    {
+      tail_measured = 0;
+      tail_bytes = 0;
     }
-  se->updateLog(logtoflush);
+  if ( lastLsn != NULL_LSN )
+    {
+      flushed_lsn = lastLsn;
+      if ( se->recoveryTargetMs() > 0 )
+        {
+          flush_marks.push_back(make_pair(firstLsn, logged_bytes));
+          logged_bytes += flush_buffer.length();
+        }
+    }
+  logtail.erase(logtail.begin(), it);
+  se->updateLog(flush_buffer.data(), flush_buffer.length(), firstLsn, lastLsn);
 }
 
 
 /* 
  * Run the analysis phase of ARIES.
  */
-void LogMgr::analyze(vector <LogRecord*> log)
+void LogMgr::analyze(const vector <LogRecord*>& log)
 {
   auto it = log.end();  
   TxType tType;
-  int lsn, txID, pageID;
   bool foundCheckpoint = false;
 
   tx_table.clear();
   dirty_page_table.clear();
+  tx_first_lsn.clear();
 
   if ( log.size() > 0 )
     {
@@ -103,7 +132,21 @@ void LogMgr::analyze(vector <LogRecord*> log)
     {
       it = log.begin();
     }
+  analyzeFrom(log, it - log.begin());
+}
+
 
+/*
+ * Run the analysis phase of ARIES over log[first] on, carrying on
+ * from the tables as they are.
+ */
+void LogMgr::analyzeFrom(const vector <LogRecord*>& log, size_t first)
+{
+  TraceScope scope("analyze");
+  scope.arg("records", log.size() - first);
+  TxType tType;
+  int lsn, txID, pageID;
+  auto it = log.begin() + first;
   while( it != log.end() )
     {
       LogRecord *logPointer = *it;
@@ -112,7 +155,18 @@ void LogMgr::analyze(vector <LogRecord*> log)
       lsn = logPointer->getLSN();
       //tx_table[txID].lastLSN = lsn;
       setLastLSN(txID, lsn);
+      if ( txID != NULL_TX && logPointer->getprevLSN() == NULL_LSN )
+        {
+          tx_first_lsn[txID] = lsn;
+        }
       
+      if ( tType == END_WRITE )
+        {
+          // the page is on disk up to here
+          EndWriteLogRecord * endWriteLogPointer = dynamic_cast<EndWriteLogRecord *>(logPointer);
+          dirty_page_table.erase(endWriteLogPointer->getPageID());
+        }
+
       if ( txID == NULL_TX )
 	{
 	  it++;
@@ -124,11 +178,7 @@ void LogMgr::analyze(vector <LogRecord*> log)
             UpdateLogRecord * updateLogPointer = dynamic_cast<UpdateLogRecord *>(logPointer);
             tx_table[txID].status = U;
             pageID = updateLogPointer->getPageID();
-            if ( dirty_page_table.find(pageID) == dirty_page_table.end() )
-              {
-                // not found                                                                           
-                dirty_page_table[pageID] = lsn; 
-              }
+            dirty_page_table.insert(pageID, lsn); // keeps an earlier recLSN
           }
       else if( tType ==  COMMIT)
           {
@@ -139,11 +189,7 @@ void LogMgr::analyze(vector <LogRecord*> log)
             CompensationLogRecord * compensationLogPointer = dynamic_cast<CompensationLogRecord *>(logPointer);
             tx_table[txID].status = U;
             pageID = compensationLogPointer->getPageID();
-            if ( dirty_page_table.find(pageID) == dirty_page_table.end() )
-              {
-                // not found
-                dirty_page_table[pageID] = lsn;
-              }
+            dirty_page_table.insert(pageID, lsn);
           }
       else if( tType ==  END)
           {
@@ -154,18 +200,87 @@ void LogMgr::analyze(vector <LogRecord*> log)
 }
 
 
+int LogMgr::redoLSN()
+{
+  int redoLsn = NULL_LSN;
+  for ( auto it = dirty_page_table.begin(); it != dirty_page_table.end(); it++ )
+    {
+      if ( redoLsn == NULL_LSN || it->second < redoLsn )
+        {
+          redoLsn = it->second;
+        }
+    }
+  return redoLsn;
+}
+
+static bool lsnBefore(LogRecord* record, int lsn)
+{
+  return record->getLSN() < lsn;
+}
+
 /*
- * Run the redo phase of ARIES.
+ * Run the redo phase of ARIES, from redoLSN() on; log must be in
+ * LSN order.
  * If the StorageEngine stops responding, return false.
  * Else when redo phase is complete, return true. 
  */
-bool LogMgr::redo(vector <LogRecord*> log)
+bool LogMgr::redo(const vector <LogRecord*>& log)
 {
+  TraceScope scope("redo");
+  long pageWrites = 0;
   TxType tType;
-  int lsn, pageID, offset, nextLsn;
+  int lsn, pageID, offset;
   string afterImage;
+  int redoLsn = redoLSN();
+  auto start = log.end();
+  if ( redoLsn != NULL_LSN )
+    {
+      start = lower_bound(log.begin(), log.end(), redoLsn, lsnBefore);
+    }
 
-  for(auto it = log.begin(); it != log.end(); it++)
+  // LSNs of the dirty pages, kept current as redo writes them, so
+  // records already on their page are skipped without loading it
+  vector <int> dirtyPages, dirtyPageLsns;
+  for ( auto it = dirty_page_table.begin(); it != dirty_page_table.end(); it++ )
+    {
+      dirtyPages.push_back(it->first);
+    }
+  se->getLSNs(dirtyPages, dirtyPageLsns);
+  DenseTable <int> pageLsn;
+  for ( unsigned i = 0; i < dirtyPages.size(); i++ )
+    {
+      pageLsn[dirtyPages[i]] = dirtyPageLsns[i];
+    }
+
+  // With page sorted redo the records of each page are applied together,
+  // still in LSN order, so a page is loaded once instead of again after
+  // every eviction, and pages are visited in id order
+  LogRecord * const * first = log.data() + (start - log.begin());
+  LogRecord * const * last = log.data() + log.size();
+  vector <LogRecord*> byPage;
+  if ( se->pageSortedRedo() )
+    {
+      DenseTable <vector <LogRecord*> > pageRecords;
+      for ( LogRecord * const * it = first; it != last; it++ )
+        {
+          if ( (*it)->getType() == UPDATE )
+            {
+              pageRecords[dynamic_cast<UpdateLogRecord *>(*it)->getPageID()].push_back(*it);
+            }
+          else if ( (*it)->getType() == CLR )
+            {
+              pageRecords[dynamic_cast<CompensationLogRecord *>(*it)->getPageID()].push_back(*it);
+            }
+        }
+      for ( auto it = pageRecords.begin(); it != pageRecords.end(); it++ )
+        {
+          byPage.insert(byPage.end(), it->second.begin(), it->second.end());
+        }
+      first = byPage.data();
+      last = first + byPage.size();
+    }
+
+  for(LogRecord * const * it = first; it != last; it++)
     {
       LogRecord *logPointer = *it;
       tType = logPointer->getType();
@@ -190,35 +305,205 @@ bool LogMgr::redo(vector <LogRecord*> log)
 	  continue;
 	}
       
-      if ( dirty_page_table.find(pageID) == dirty_page_table.end() )
+      auto dirty = dirty_page_table.find(pageID);
+      if ( dirty == dirty_page_table.end() )
         {
+          METRIC_INC(METRIC_REDO_SKIPPED);
           continue;
         }
-      if( dirty_page_table[pageID] <= lsn && se->getLSN(pageID) < lsn )
+      if( dirty->second <= lsn && pageLsn[pageID] < lsn )
         {
           if( !(se->pageWrite(pageID, offset, afterImage, lsn)) )
             {
+              scope.arg("page_writes", pageWrites);
               return false;
             }
+          pageLsn[pageID] = lsn;
+          ++pageWrites;
+          METRIC_INC(METRIC_REDO_APPLIED);
+        }
+      else
+        {
+          METRIC_INC(METRIC_REDO_SKIPPED);
         }
     }
 
+  endCommitted();
+  scope.arg("page_writes", pageWrites);
+  return true;
+}
+
+
+/*
+ * Log an end record for each transaction analysis found committed and
+ * drop it from the TX table.
+ */
+void LogMgr::endCommitted()
+{
   vector <int> txToErase;
   for ( auto it = tx_table.begin(); it != tx_table.end(); it++ )
     {
       if( it->second.status == C && it->first != NULL_TX )
         {
-	  nextLsn = se->nextLSN();
+          int nextLsn = se->nextLSN();
           logtail.push_back(new LogRecord(nextLsn, it->second.lastLSN, it->first, END));
 	  txToErase.push_back(it->first);
         }
     }
-  for ( int i = 0; i < txToErase.size(); i++ )
+  for ( unsigned i = 0; i < txToErase.size(); i++ )
     {
       tx_table.erase(txToErase[i]);
     }
+}
 
-  return true;
+
+void LogMgr::markDirty(int page_id, int lsn)
+{
+  dirty_page_table.insert(page_id, lsn);
+  if ( checkpoint_rec_lsn == NULL_LSN )
+    {
+      checkpoint_rec_lsn = lsn;
+    }
+}
+
+
+int LogMgr::linkPageChain(int page_id, int lsn)
+{
+  int prevLsn = NULL_LSN;
+  auto it = page_chain_heads.find(page_id);
+  if ( it != page_chain_heads.end() )
+    {
+      prevLsn = it->second;
+      it->second = lsn;
+    }
+  else
+    {
+      page_chain_heads.insert(page_id, lsn);
+    }
+  return prevLsn;
+}
+
+
+/*
+ * Where the line of the record with this LSN starts in log, text whose
+ * lines are in LSN order, found by binary search; string::npos if there
+ * is no such line. end is set to where the line ends.
+ */
+static size_t findRecordLine(const string& log, int lsn, size_t& end)
+{
+  size_t lo = 0;               // always the start of a line
+  size_t hi = log.length();    // the start of a line, or the end
+  while ( lo < hi )
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      size_t start = mid == 0 ? 0 : log.rfind('\n', mid - 1) + 1;
+      end = log.find('\n', start);
+      if ( end == string::npos )
+        {
+          end = log.length();
+        }
+      int lineLsn = (int)strtol(log.c_str() + start, NULL, 10);
+      if ( lineLsn == lsn )
+        {
+          return start;
+        }
+      if ( lineLsn < lsn )
+        {
+          lo = min(end + 1, log.length());
+        }
+      else
+        {
+          hi = start;
+        }
+    }
+  return string::npos;
+}
+
+
+LogRecord* LogMgr::findRecord(int lsn, string& log, bool& logRead, vector <LogRecord*>& parsed)
+{
+  auto it = lower_bound(logtail.begin(), logtail.end(), lsn, lsnBefore);
+  if ( it != logtail.end() && (*it)->getLSN() == lsn )
+    {
+      return *it;
+    }
+  // read just the flush that holds it where the engine knows it, else
+  // the whole log, once
+  string flush;
+  const string* text = &flush;
+  if ( logRead || !se->readLogFlush(lsn, flush) )
+    {
+      if ( !logRead )
+        {
+          log = se->getLog();
+          logRead = true;
+        }
+      text = &log;
+    }
+  size_t end;
+  size_t start = findRecordLine(*text, lsn, end);
+  if ( start == string::npos )
+    {
+      return NULL;
+    }
+  LogRecord* record = LogRecord::parseRecord(text->data() + start, end - start);
+  parsed.push_back(record);
+  return record;
+}
+
+
+bool LogMgr::pageChain(int page_id, int after_lsn, vector<WriteOp>& writes, vector<int>& lsns)
+{
+  TraceScope scope("page_chain");
+  writes.clear();
+  lsns.clear();
+  int lsn = NULL_LSN;
+  auto head = page_chain_heads.find(page_id);
+  if ( head != page_chain_heads.end() )
+    {
+      lsn = head->second;
+    }
+  string log;
+  bool logRead = false;
+  vector <LogRecord*> parsed;
+  bool whole = true;
+  while ( whole && lsn != NULL_LSN && lsn > after_lsn )
+    {
+      LogRecord* record = findRecord(lsn, log, logRead, parsed);
+      whole = false;
+      if ( record != NULL && record->getType() == UPDATE )
+        {
+          UpdateLogRecord * update = dynamic_cast<UpdateLogRecord *>(record);
+          if ( update->getPageID() == page_id && update->hasPageChain() )
+            {
+              writes.push_back(WriteOp(page_id, update->getOffset(), update->getAfterImage()));
+              lsn = update->getPagePrevLSN();
+              whole = true;
+            }
+        }
+      else if ( record != NULL && record->getType() == CLR )
+        {
+          CompensationLogRecord * clr = dynamic_cast<CompensationLogRecord *>(record);
+          if ( clr->getPageID() == page_id && clr->hasPageChain() )
+            {
+              writes.push_back(WriteOp(page_id, clr->getOffset(), clr->getAfterImage()));
+              lsn = clr->getPagePrevLSN();
+              whole = true;
+            }
+        }
+      if ( whole )
+        {
+          lsns.push_back(record->getLSN());
+        }
+    }
+  for ( unsigned i = 0; i < parsed.size(); i++ )
+    {
+      delete parsed[i];
+    }
+  reverse(writes.begin(), writes.end());
+  reverse(lsns.begin(), lsns.end());
+  scope.arg("records", lsns.size());
+  return whole;
 }
 
 
@@ -229,11 +514,11 @@ bool LogMgr::redo(vector <LogRecord*> log)
  */
 void LogMgr::undo(vector <LogRecord*> log, int txnum)
 {
+  TraceScope scope("undo");
+  scope.arg("txid", txnum);
+  long pageWrites = 0;
   vector <int> loserTxID;
-  priority_queue <int> ToUndo;
-  int lsn, lastLsn, nextLsn, txID, pageID, offset, prevLsn, undoNextLsn, toUndoLsn;
-  TxType tType;
-  string beforeImage;
+  int lsn, lastLsn;
 
   // If a txnum is provided, abort that transaction.
   if ( txnum != NULL_TX )
@@ -258,9 +543,27 @@ void LogMgr::undo(vector <LogRecord*> log, int txnum)
         }
     }
 
-  for ( int i = 0; i < loserTxID.size(); i++ )
+  rollback(log, loserTxID, pageWrites);
+  scope.arg("page_writes", pageWrites);
+}
+
+
+/*
+ * Roll back the transactions in losers together, latest update first,
+ * writing a CLR for each update undone and an end record for each
+ * transaction finished. Returns false if the StorageEngine stops
+ * accepting writes.
+ */
+bool LogMgr::rollback(const vector <LogRecord*>& log, const vector <int>& losers, long& pageWrites)
+{
+  priority_queue <int> ToUndo;
+  int lsn, lastLsn, nextLsn, txID, pageID, offset, prevLsn, undoNextLsn, toUndoLsn;
+  TxType tType;
+  string beforeImage;
+
+  for ( unsigned i = 0; i < losers.size(); i++ )
     {
-      ToUndo.push(tx_table[loserTxID[i]].lastLSN);
+      ToUndo.push(tx_table[losers[i]].lastLSN);
     }
 
   LogRecord *logPointer;
@@ -297,20 +600,31 @@ void LogMgr::undo(vector <LogRecord*> log, int txnum)
           offset = updateLogPointer->getOffset();
           beforeImage = updateLogPointer->getBeforeImage();
           prevLsn = updateLogPointer->getprevLSN();
+          // after an instant restart, the page is brought up to date
+          // before the CLR takes its LSN, charged to the crash's budget
+          // rather than to an abort's
+          if ( !se->recoverDeferredPage(pageID) )
+            {
+              return false;
+            }
           lastLsn = getLastLSN(txID);
           nextLsn = se->nextLSN();
-          logtail.push_back(new CompensationLogRecord(nextLsn, lastLsn, txID, pageID, offset, beforeImage, prevLsn));
+          CompensationLogRecord * clr = new CompensationLogRecord(nextLsn, lastLsn, txID, pageID, offset, beforeImage, prevLsn);
+          if ( se->pageChainLogging() )
+            {
+              clr->setPagePrevLSN(linkPageChain(pageID, nextLsn));
+            }
+          logtail.push_back(clr);
+          METRIC_INC(METRIC_CLRS_WRITTEN);
           setLastLSN(txID, nextLsn);
           tx_table[txID].status = U;
           
-          if ( dirty_page_table.find(pageID) == dirty_page_table.end() )
-            {
-              dirty_page_table[pageID] = nextLsn; 
-            }
+          markDirty(pageID, nextLsn);
           if( !(se->pageWrite(pageID, offset, beforeImage, nextLsn)) )
             {
-              return;
+              return false;
             }
+          ++pageWrites;
           if ( prevLsn == NULL_LSN )
             {
               logtail.push_back( new LogRecord(se->nextLSN(), nextLsn, txID, END) );
@@ -354,19 +668,26 @@ void LogMgr::undo(vector <LogRecord*> log, int txnum)
             }
         }
     }
+  return true;
 }
 
 
-vector<LogRecord*> LogMgr::stringToLRVector(string logstring)
+vector<LogRecord*> LogMgr::stringToLRVector(const string& logstring)
 {
+  TraceScope scope("parse");
   vector<LogRecord*> result;
-  istringstream stream(logstring);
-  string line;
-  while (getline(stream, line)) 
+  const char* line = logstring.data();
+  const char* end = line + logstring.length();
+  while (line != end)
     {
-      LogRecord* lr = LogRecord::stringToRecordPtr(line);
-      result.push_back(lr);
+      const char* newline = (const char*)memchr(line, '\n', end - line);
+      const char* lineEnd = newline ? newline : end;
+      result.push_back(LogRecord::parseRecord(line, lineEnd - line));
+      line = newline ? newline + 1 : end;
     }
+  METRIC_ADD(METRIC_RECORDS_PARSED, result.size());
+  METRIC_ADD(METRIC_BYTES_PARSED, logstring.length());
+  scope.arg("records", result.size());
   return result; 
 }
 
@@ -377,6 +698,11 @@ vector<LogRecord*> LogMgr::stringToLRVector(string logstring)
  */
 void LogMgr::abort(int txid)
 {
+  if ( !validTxid(txid) )
+    {
+      return;
+    }
+  flushDueCommits();
   string logString = se->getLog();
   vector <LogRecord*> log = stringToLRVector(logString);
   log.insert( log.end(), logtail.begin(), logtail.end() );
@@ -389,16 +715,50 @@ void LogMgr::abort(int txid)
  */
 void LogMgr::checkpoint()
 {
+  lock_guard<recursive_mutex> guard(se->engineMutex());
+  flushDueCommits();
   int beginCheckpointLsn = se->nextLSN();
   int endCheckpointLsn = se->nextLSN();
   // Step 1: Log a begin_checkpoint
   logtail.push_back(new LogRecord(beginCheckpointLsn, NULL_LSN, NULL_TX, BEGIN_CKPT));
   // Step 2: Log a end_checkpoint
   logtail.push_back(new ChkptLogRecord(endCheckpointLsn, beginCheckpointLsn, NULL_TX, tx_table, dirty_page_table));
+  checkpoint_rec_lsn = redoLSN();
   // Step 3: Flush the log tail
   flushLogTail(endCheckpointLsn);
   // Step 4: Store the begin checkpoint at the master
   se->store_master(beginCheckpointLsn);
+  // Step 5: Let go of the log nothing can need any more
+  se->truncateLog(recoveryHorizon(beginCheckpointLsn));
+}
+
+
+/*
+ * The oldest LSN restart or rollback could still read: the earliest of
+ * the checkpoint, the recLSN of every dirty page and the first record of
+ * every active transaction. NULL_LSN if an active transaction started
+ * before what this LogMgr has seen, as its first record is unknown.
+ */
+int LogMgr::recoveryHorizon(int checkpointLsn)
+{
+  int horizon = checkpointLsn;
+  for ( auto it = dirty_page_table.begin(); it != dirty_page_table.end(); it++ )
+    {
+      horizon = min(horizon, it->second);
+    }
+  DenseTable <int> firstLsns;
+  for ( auto it = tx_table.begin(); it != tx_table.end(); it++ )
+    {
+      auto first = tx_first_lsn.find(it->first);
+      if ( first == tx_first_lsn.end() )
+        {
+          return NULL_LSN;
+        }
+      horizon = min(horizon, first->second);
+      firstLsns.insert(first->first, first->second);
+    }
+  tx_first_lsn.swap(firstLsns); // forget finished transactions
+  return horizon;
 }
 
 
@@ -407,13 +767,153 @@ void LogMgr::checkpoint()
  */
 void LogMgr::commit(int txid)
 {
+  lock_guard<recursive_mutex> guard(se->engineMutex());
+  if ( !validTxid(txid) )
+    {
+      return;
+    }
+  if ( se->asyncCommit() )
+    {
+      commitAsync(txid);
+      return;
+    }
+  flushDueCommits();
+  int nextLsn = commitRecord(txid);
+  flushLogTail(nextLsn); // Write to the log tail to disk
+  endCommit(txid, nextLsn);
+}
+
+bool LogMgr::validTxid(int txid)
+{
+  if ( DenseTable <txTableEntry>::validId(txid) )
+    {
+      return true;
+    }
+  cerr << "txid " << txid << " is out of range 0 to " << DenseTable <txTableEntry>::MAX_ID << endl;
+  return false;
+}
+
+int LogMgr::commitAsync(int txid)
+{
+  lock_guard<recursive_mutex> guard(se->engineMutex());
+  if ( !validTxid(txid) )
+    {
+      return NULL_LSN;
+    }
+  flushDueCommits();
+  int nextLsn = commitRecord(txid);
+  pending_commits.push_back(PendingCommit(txid, nextLsn, chrono::steady_clock::now()));
+  if ( pending_commits.size() == 1 )
+    {
+      scheduleCommitFlush();
+    }
+  return nextLsn;
+}
+
+int LogMgr::flushedLSN()
+{
+  lock_guard<recursive_mutex> guard(se->engineMutex());
+  return logtail.empty() ? flushed_lsn : logtail.front()->getLSN() - 1;
+}
+
+void LogMgr::waitDurable(int lsn)
+{
+  lock_guard<recursive_mutex> guard(se->engineMutex());
+  if ( !logtail.empty() && logtail.front()->getLSN() <= lsn )
+    {
+      flushLogTail(lsn);
+    }
+}
+
+void LogMgr::flushCommits()
+{
+  lock_guard<recursive_mutex> guard(se->engineMutex());
+  if ( !pending_commits.empty() )
+    {
+      waitDurable(pending_commits.back().lsn);
+      flushDueCommits();
+    }
+}
+
+void LogMgr::flushDueCommits()
+{
+  lock_guard<recursive_mutex> guard(se->engineMutex());
+  if ( pending_commits.empty() )
+    {
+      return;
+    }
+  unsigned delayMs = se->asyncCommitDelayMs();
+  unsigned long maxBytes = se->asyncCommitBytes();
+  bool due = delayMs > 0 && chrono::steady_clock::now() - pending_commits.front().logged
+                              >= chrono::milliseconds(delayMs);
+  if ( !due && maxBytes > 0 )
+    {
+      for ( ; tail_measured < logtail.size(); tail_measured++ )
+        {
+          flush_buffer.clear();
+          logtail[tail_measured]->serializeInto(flush_buffer);
+          tail_bytes += flush_buffer.length();
+        }
+      due = tail_bytes >= maxBytes;
+    }
+  if ( due )
+    {
+      waitDurable(pending_commits.back().lsn);
+    }
+  // a commit is over once its record is on disk, however it got there
+  int durable = flushedLSN();
+  unsigned ended = 0;
+  while ( ended < pending_commits.size() && pending_commits[ended].lsn <= durable )
+    {
+      endCommit(pending_commits[ended].txid, pending_commits[ended].lsn);
+      ended++;
+    }
+  pending_commits.erase(pending_commits.begin(), pending_commits.begin() + ended);
+  if ( ended > 0 )
+    {
+      scheduleCommitFlush();
+    }
+}
+
+void LogMgr::scheduleCommitFlush()
+{
+  unsigned delayMs = se->asyncCommitDelayMs();
+  if ( pending_commits.empty() || delayMs == 0 )
+    {
+      se->cancelCommitFlush(this);
+    }
+  else
+    {
+      se->scheduleCommitFlush(this, pending_commits.front().logged + chrono::milliseconds(delayMs));
+    }
+}
+
+int LogMgr::commitRecord(int txid)
+{
+  lock_guard<recursive_mutex> guard(se->engineMutex());
+  if ( !validTxid(txid) )
+    {
+      return NULL_LSN;
+    }
+  se->recoverDeferred(txid);
   int lastLsn = getLastLSN(txid);
   int nextLsn = se->nextLSN();
   logtail.push_back( new LogRecord(nextLsn, lastLsn, txid, COMMIT) );
   setLastLSN(txid, nextLsn);
   tx_table.erase(txid);
-  flushLogTail(nextLsn); // Write to the log tail to disk
-  logtail.push_back( new LogRecord(se->nextLSN(), nextLsn, txid, END) );
+  return nextLsn;
+}
+
+void LogMgr::forceLog(int lsn)
+{
+  lock_guard<recursive_mutex> guard(se->engineMutex());
+  flushLogTail(lsn);
+}
+
+void LogMgr::endCommit(int txid, int commitLsn)
+{
+  lock_guard<recursive_mutex> guard(se->engineMutex());
+  logtail.push_back( new LogRecord(se->nextLSN(), commitLsn, txid, END) );
 }
 
 
@@ -425,8 +925,14 @@ void LogMgr::commit(int txid)
 void LogMgr::pageFlushed(int page_id)
 {
   int maxlsn = se->getLSN(page_id);
+  METRIC_INC(METRIC_WAL_FORCES);
   flushLogTail(maxlsn);
   dirty_page_table.erase(page_id);
+  if ( se->pageFlushLogging() )
+    {
+      // reaches the disk with a later flush, after the page does
+      logtail.push_back(new EndWriteLogRecord(se->nextLSN(), NULL_LSN, NULL_TX, page_id));
+    }
 }
 
 
@@ -435,12 +941,380 @@ void LogMgr::pageFlushed(int page_id)
  */
 void LogMgr::recover(string log)
 {
+  TraceScope scope("recover");
+  recovery_stats = RecoveryStats();
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
   vector<LogRecord*> logRec = stringToLRVector(log);
-  analyze(logRec);
+  chrono::steady_clock::time_point parsed = chrono::steady_clock::now();
+  size_t known = recovered_log.size();
+  bool checkpointed = false;
+  for ( unsigned i = 0; i < logRec.size(); i++ )
+    {
+      checkpointed = checkpointed || logRec[i]->getType() == END_CKPT;
+    }
+  if ( known > 0 )
+    {
+      logRec.insert( logRec.begin(), recovered_log.begin(), recovered_log.end() );
+    }
+  if ( known > 0 && !checkpointed )
+    {
+      // carry on from where the interrupted recovery's analysis stopped
+      tx_table = analyzed_tx_table;
+      dirty_page_table = analyzed_dirty_pages;
+      tx_first_lsn = analyzed_first_lsns;
+      analyzeFrom(logRec, known);
+    }
+  else
+    {
+      analyze(logRec);
+    }
+  chrono::steady_clock::time_point analyzed = chrono::steady_clock::now();
+  recovered_log = logRec;
+  recovered_bytes += log.length();
+  if ( se->recoveryTargetMs() > 0 )
+    {
+      // for logBytesSince, taking the records to be all of a size
+      for ( size_t i = 0; i < logRec.size(); i += 1024 )
+        {
+          flush_marks.push_back(make_pair(logRec[i]->getLSN(), (unsigned long)(recovered_bytes * i / logRec.size())));
+        }
+      logged_bytes = recovered_bytes;
+    }
+  analyzed_tx_table = tx_table;
+  analyzed_dirty_pages = dirty_page_table;
+  analyzed_first_lsns = tx_first_lsn;
+  checkpoint_rec_lsn = redoLSN();
+  recovery_stats.log_records = (int)logRec.size();
+  recovery_stats.reused_records = (int)known;
+  recovery_stats.dirty_pages = (int)dirty_page_table.size();
+  if ( se->pageChainLogging() )
+    {
+      // records logged from here on chain back to each page's latest
+      for ( unsigned i = 0; i < logRec.size(); i++ )
+        {
+          if ( logRec[i]->getType() == UPDATE )
+            {
+              page_chain_heads[dynamic_cast<UpdateLogRecord *>(logRec[i])->getPageID()] = logRec[i]->getLSN();
+            }
+          else if ( logRec[i]->getType() == CLR )
+            {
+              page_chain_heads[dynamic_cast<CompensationLogRecord *>(logRec[i])->getPageID()] = logRec[i]->getLSN();
+            }
+        }
+    }
+  recovery_stats.parse_seconds = chrono::duration<double>(parsed - start).count();
+  recovery_stats.analyze_seconds = chrono::duration<double>(analyzed - parsed).count();
+  if ( se->instantRestart() )
+    {
+      deferRecovery(logRec, false);
+      recovery_stats.deferred_pages = (int)deferred_pages.size();
+      recovery_stats.deferred_losers = (int)deferred_losers.size();
+      return;
+    }
   if(redo(logRec))
     {
-      undo(logRec);
+      chrono::steady_clock::time_point redone = chrono::steady_clock::now();
+      recovery_stats.redone = true;
+      recovery_stats.redo_seconds = chrono::duration<double>(redone - analyzed).count();
+      if ( se->backgroundUndo() )
+        {
+          // the losers are rolled back as new work reaches their pages
+          deferRecovery(logRec, true);
+          recovery_stats.deferred_losers = (int)deferred_losers.size();
+        }
+      else
+        {
+          undo(logRec);
+        }
+      recovery_stats.undo_seconds = chrono::duration<double>(chrono::steady_clock::now() - redone).count();
     }
+  else
+    {
+      recovery_stats.redo_seconds = chrono::duration<double>(chrono::steady_clock::now() - analyzed).count();
+    }
+}
+
+
+/*
+ * The loser that stands for txid's group; group maps each loser to
+ * another of its group, and a group's leader to itself.
+ */
+static int groupOf(DenseTable <int>& group, int txid)
+{
+  while ( group[txid] != txid )
+    {
+      group[txid] = group[group[txid]];
+      txid = group[txid];
+    }
+  return txid;
+}
+
+/*
+ * Instead of undo, and of redo unless redone, note what each page
+ * needs: its records from redoLSN() on, and the losers that wrote it.
+ * Committed transactions are ended now, as redo would.
+ */
+void LogMgr::deferRecovery(const vector <LogRecord*>& log, bool redone)
+{
+  TraceScope scope("defer");
+  int redoLsn = redone ? NULL_LSN : redoLSN();
+  auto start = log.end();
+  if ( redoLsn != NULL_LSN )
+    {
+      start = lower_bound(log.begin(), log.end(), redoLsn, lsnBefore);
+    }
+  for ( auto it = start; it != log.end(); it++ )
+    {
+      int pageID;
+      if ( (*it)->getType() == UPDATE )
+        {
+          pageID = dynamic_cast<UpdateLogRecord *>(*it)->getPageID();
+        }
+      else if ( (*it)->getType() == CLR )
+        {
+          pageID = dynamic_cast<CompensationLogRecord *>(*it)->getPageID();
+        }
+      else
+        {
+          continue;
+        }
+      if ( dirty_page_table.contains(pageID) )
+        {
+          deferred_pages[pageID].push_back(*it);
+        }
+    }
+
+  // losers that wrote a common page are rolled back as one group, so
+  // their updates are still undone latest first, as undo would
+  DenseTable <int> group;
+  for ( auto it = tx_table.begin(); it != tx_table.end(); it++ )
+    {
+      if ( it->second.status != C )
+        {
+          group.insert(it->first, it->first);
+        }
+    }
+  for ( unsigned i = 0; !group.empty() && i < log.size(); i++ )
+    {
+      if ( log[i]->getType() != UPDATE || !group.contains(log[i]->getTxID()) )
+        {
+          continue;
+        }
+      int pageID = dynamic_cast<UpdateLogRecord *>(log[i])->getPageID();
+      vector <int>& losers = page_losers[pageID];
+      if ( losers.empty() || losers.back() != log[i]->getTxID() )
+        {
+          losers.push_back(log[i]->getTxID());
+        }
+      int leader = groupOf(group, losers[0]);
+      group[groupOf(group, log[i]->getTxID())] = leader;
+      deferred_pages[pageID];
+    }
+  for ( auto it = group.begin(); it != group.end(); it++ )
+    {
+      int leader = groupOf(group, it->first);
+      deferred_losers.insert(it->first, leader);
+      loser_groups[leader].push_back(it->first);
+    }
+  if ( !redone )
+    {
+      endCommitted();
+    }
+  scope.arg("pages", (long)deferred_pages.size());
+  scope.arg("losers", (long)deferred_losers.size());
+}
+
+
+bool LogMgr::recoveryDeferred()
+{
+  return !deferred_pages.empty() || !deferred_losers.empty();
+}
+
+
+/*
+ * Bring a page an instant restart deferred up to date: redo its
+ * records, then roll back each loser that wrote it.
+ */
+bool LogMgr::recoverPage(int page_id)
+{
+  auto page = deferred_pages.find(page_id);
+  if ( page == deferred_pages.end() )
+    {
+      return true;
+    }
+  TraceScope scope("recover_page");
+  scope.arg("page_id", page_id);
+  vector <LogRecord*> records;
+  records.swap(page->second);
+
+  vector <int> pageIds(1, page_id), pageLsns;
+  se->getLSNs(pageIds, pageLsns);
+  int pageLsn = pageLsns[0];
+  for ( unsigned i = 0; i < records.size(); i++ )
+    {
+      int lsn = records[i]->getLSN();
+      int offset;
+      string afterImage;
+      if ( records[i]->getType() == UPDATE )
+        {
+          UpdateLogRecord * updateLogPointer = dynamic_cast<UpdateLogRecord *>(records[i]);
+          afterImage = updateLogPointer->getAfterImage();
+          offset = updateLogPointer->getOffset();
+        }
+      else
+        {
+          CompensationLogRecord * compensationLogPointer = dynamic_cast<CompensationLogRecord *>(records[i]);
+          afterImage = compensationLogPointer->getAfterImage();
+          offset = compensationLogPointer->getOffset();
+        }
+      auto dirty = dirty_page_table.find(page_id);
+      if ( dirty != dirty_page_table.end() && dirty->second <= lsn && pageLsn < lsn )
+        {
+          if( !(se->pageWrite(page_id, offset, afterImage, lsn)) )
+            {
+              // the page still needs this record and those after it
+              deferred_pages[page_id].assign(records.begin() + i, records.end());
+              return false;
+            }
+          pageLsn = lsn;
+          METRIC_INC(METRIC_REDO_APPLIED);
+        }
+      else
+        {
+          METRIC_INC(METRIC_REDO_SKIPPED);
+        }
+    }
+  deferred_pages.erase(page_id);
+
+  vector <int> losers;
+  auto written = page_losers.find(page_id);
+  if ( written != page_losers.end() )
+    {
+      losers.swap(written->second);
+      page_losers.erase(page_id);
+    }
+  for ( unsigned i = 0; i < losers.size(); i++ )
+    {
+      if ( !recoverTx(losers[i]) )
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+
+/*
+ * Roll back txid, with the rest of its group, if it is a loser an
+ * instant restart has not rolled back yet. Each page they wrote is
+ * brought up to date first.
+ */
+bool LogMgr::recoverTx(int txid)
+{
+  auto loser = deferred_losers.find(txid);
+  if ( loser == deferred_losers.end() )
+    {
+      return true;
+    }
+  TraceScope scope("recover_tx");
+  scope.arg("txid", txid);
+  vector <int> losers;
+  int leader = loser->second;
+  losers.swap(loser_groups[leader]);
+  loser_groups.erase(leader);
+  for ( unsigned i = 0; i < losers.size(); i++ )
+    {
+      deferred_losers.erase(losers[i]);
+    }
+  long pageWrites = 0;
+  bool done = rollback(recovered_log, losers, pageWrites);
+  scope.arg("page_writes", pageWrites);
+  return done;
+}
+
+
+bool LogMgr::recoverNextPage()
+{
+  if ( !deferred_pages.empty() )
+    {
+      return recoverPage(deferred_pages.begin()->first);
+    }
+  if ( !deferred_losers.empty() )
+    {
+      return recoverTx(deferred_losers.begin()->first);
+    }
+  return true;
+}
+
+
+/*
+ * Takes over the parsed log and analysis of previous's recover().
+ */
+void LogMgr::resumeRecovery(LogMgr& previous)
+{
+  recovered_log.swap(previous.recovered_log);
+  recovered_bytes = previous.recovered_bytes;
+  analyzed_tx_table.swap(previous.analyzed_tx_table);
+  analyzed_dirty_pages.swap(previous.analyzed_dirty_pages);
+  analyzed_first_lsns.swap(previous.analyzed_first_lsns);
+  previous.recovered_bytes = 0;
+}
+
+
+size_t LogMgr::recoveredLogBytes()
+{
+  return recovered_bytes;
+}
+
+
+void LogMgr::dirtyPagesByAge(vector <pair<int, int> >& pages)
+{
+  pages.clear();
+  for ( auto it = dirty_page_table.begin(); it != dirty_page_table.end(); it++ )
+    {
+      pages.push_back(make_pair(it->second, it->first));
+    }
+  sort(pages.begin(), pages.end());
+}
+
+
+int LogMgr::restartRedoLSN()
+{
+  int lsn = redoLSN();
+  if ( !se->pageFlushLogging() && checkpoint_rec_lsn != NULL_LSN )
+    {
+      lsn = lsn == NULL_LSN ? checkpoint_rec_lsn : min(lsn, checkpoint_rec_lsn);
+    }
+  return lsn;
+}
+
+
+static bool markBefore(int lsn, const pair<int, unsigned long>& mark)
+{
+  return lsn < mark.first;
+}
+
+unsigned long LogMgr::logBytesSince(int lsn)
+{
+  auto it = upper_bound(flush_marks.begin(), flush_marks.end(), lsn, markBefore);
+  if ( it == flush_marks.begin() )
+    {
+      return logged_bytes;
+    }
+  --it;
+  unsigned long bytes = logged_bytes - it->second;
+  // the least recLSN seldom goes back, so marks well before it can go
+  if ( (size_t)(it - flush_marks.begin()) > flush_marks.size() / 2 )
+    {
+      flush_marks.erase(flush_marks.begin(), it);
+    }
+  return bytes;
+}
+
+
+RecoveryStats LogMgr::getRecoveryStats()
+{
+  return recovery_stats;
 }
 
 /*
@@ -448,16 +1322,59 @@ void LogMgr::recover(string log)
  */
 int LogMgr::write(int txid, int page_id, int offset, string input, string oldtext)
 {
+  flushDueCommits();
   int nextLsn = se->nextLSN();
   int lastLsn = getLastLSN(txid);
-  logtail.push_back( new UpdateLogRecord(nextLsn, lastLsn, txid, page_id, offset, oldtext, input) );
+  if ( lastLsn == NULL_LSN )
+    {
+      tx_first_lsn[txid] = nextLsn;
+    }
+  UpdateLogRecord * update = new UpdateLogRecord(nextLsn, lastLsn, txid, page_id, offset, oldtext, input);
+  if ( se->pageChainLogging() )
+    {
+      update->setPagePrevLSN(linkPageChain(page_id, nextLsn));
+    }
+  logtail.push_back(update);
   setLastLSN(txid, nextLsn);
   tx_table[txid].status = U;
-  if( dirty_page_table.find(page_id) == dirty_page_table.end() )
+  markDirty(page_id, nextLsn);
+  return nextLsn;
+}
+
+
+/*
+ * Logs a group of updates for one transaction with a single LSN
+ * reservation and a single growth of the log tail.
+ */
+int LogMgr::writeBatch(int txid, const vector<WriteOp>& ops, const vector<string>& olds)
+{
+  if ( ops.empty() )
     {
-      dirty_page_table[page_id] = nextLsn;
+      return NULL_LSN;
     }
-  return nextLsn;
+  flushDueCommits();
+  int firstLsn = se->nextLSNs( (int)ops.size() );
+  int lastLsn = getLastLSN(txid);
+  if ( lastLsn == NULL_LSN )
+    {
+      tx_first_lsn[txid] = firstLsn;
+    }
+  logtail.reserve( logtail.size() + ops.size() );
+  for ( unsigned i = 0; i < ops.size(); i++ )
+    {
+      int nextLsn = firstLsn + i;
+      UpdateLogRecord * update = new UpdateLogRecord(nextLsn, lastLsn, txid, ops[i].page_id, ops[i].offset, olds[i], ops[i].bytes);
+      if ( se->pageChainLogging() )
+        {
+          update->setPagePrevLSN(linkPageChain(ops[i].page_id, nextLsn));
+        }
+      logtail.push_back(update);
+      markDirty(ops[i].page_id, nextLsn);
+      lastLsn = nextLsn;
+    }
+  setLastLSN(txid, lastLsn);
+  tx_table[txid].status = U;
+  return firstLsn;
 }
 
 
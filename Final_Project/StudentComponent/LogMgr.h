@@ -2,6 +2,7 @@
 #define LOGMGR_H_
 
 #include "LogRecord.h"
+#include <chrono>
 #include <vector>
 #include "../StorageEngine/StorageEngine.h"
 
@@ -11,15 +12,101 @@ using namespace std;
 const int NULL_LSN = -1;
 const int NULL_TX = -1;
 
+/*
+ * Wall time of each step of the last recover() call, with the size of
+ * the log it read and of the dirty page table analysis rebuilt.
+ * reused_records of the log records were taken over from an interrupted
+ * recovery rather than parsed again. redone is false if the
+ * StorageEngine stopped accepting writes before redo finished, or if an
+ * instant restart left redo for later; deferred_pages is then how many
+ * pages it left. deferred_losers is how many losers an instant restart
+ * or background undo left to be rolled back later.
+ */
+struct RecoveryStats {
+  double parse_seconds;
+  double analyze_seconds;
+  double redo_seconds;
+  double undo_seconds;
+  bool redone;
+  int log_records;
+  int reused_records;
+  int dirty_pages;
+  int deferred_pages;
+  int deferred_losers;
 
+  RecoveryStats() {
+    deferred_pages = 0;
+    deferred_losers = 0;
+    log_records = 0;
+    reused_records = 0;
+    dirty_pages = 0;
+    parse_seconds = 0;
+    analyze_seconds = 0;
+    redo_seconds = 0;
+    undo_seconds = 0;
+    redone = false;
+  }
+};
+
+
+
+/*
+ * A commit whose record may not be on disk yet, and when it was logged.
+ */
+struct PendingCommit {
+  int txid;
+  int lsn;
+  chrono::steady_clock::time_point logged;
+
+  PendingCommit(int tx, int commit_lsn, chrono::steady_clock::time_point at) :
+    txid(tx), lsn(commit_lsn), logged(at) {}
+};
 
 ///////////////////  LogMgr  ///////////////////
 
 class LogMgr {
  private:
-  map <int, txTableEntry> tx_table;
-  map <int, int> dirty_page_table;
+  DenseTable <txTableEntry> tx_table;
+  DenseTable <int> dirty_page_table;
+  //LSN of the first record of each transaction, for log truncation
+  DenseTable <int> tx_first_lsn;
   vector <LogRecord*> logtail; 
+  string flush_buffer; //reused by flushLogTail, so it keeps its capacity
+  //async commits not yet known to be on disk, oldest first, and for the
+  //byte bound, the size of the first tail_measured records of logtail
+  vector <PendingCommit> pending_commits;
+  int flushed_lsn = NULL_LSN; //the last record flushLogTail wrote
+  //with a recovery time target, for logBytesSince: the first LSN of
+  //each log flush with the bytes of log before it, and the total
+  vector <pair<int, unsigned long> > flush_marks;
+  unsigned long logged_bytes = 0;
+  //the least recLSN in the dirty page table of the last checkpoint, or
+  //of the recovered log, or of the first page dirtied after that if the
+  //table was empty: where a restart would redo from without page flush
+  //logging, as its analysis cannot see pages written back since
+  int checkpoint_rec_lsn = NULL_LSN;
+  size_t tail_measured = 0;
+  unsigned long tail_bytes = 0;
+  RecoveryStats recovery_stats;
+  //what the last recover() read: the records of the first recovered_bytes
+  //of log text, and the tables analysis built from them, before redo and
+  //undo changed them. Kept for resumeRecovery.
+  vector <LogRecord*> recovered_log;
+  size_t recovered_bytes = 0;
+  DenseTable <txTableEntry> analyzed_tx_table;
+  DenseTable <int> analyzed_dirty_pages;
+  DenseTable <int> analyzed_first_lsns;
+  //what an instant restart left for later: the records each page still
+  //needs redone, in LSN order, the losers that wrote each page, and the
+  //losers not yet rolled back, each with the leader of the group it is
+  //rolled back with, and the members of each group by leader
+  DenseTable <vector <LogRecord*> > deferred_pages;
+  DenseTable <vector <int> > page_losers;
+  DenseTable <int> deferred_losers;
+  DenseTable <vector <int> > loser_groups;
+  //with page chain logging, the LSN of the latest update or CLR logged
+  //on each page, which the page's next record chains back to
+  DenseTable <int> page_chain_heads;
 
   /*
    * Find the LSN of the most recent log record for this TX.
@@ -41,19 +128,80 @@ class LogMgr {
    */
   void flushLogTail(int maxLSN);
 
-  StorageEngine* se;
+  /*
+   * Has the engine's commit flusher come back for the oldest pending
+   * commit at its delay bound, or not at all if none is left.
+   */
+  void scheduleCommitFlush();
+
+  /*
+   * The oldest LSN that restart or rollback may still need once the
+   * checkpoint starting at checkpointLsn is stored, or NULL_LSN if
+   * that cannot be told. Log below it may be truncated.
+   */
+  int recoveryHorizon(int checkpointLsn);
+
+  StorageEngine* se = NULL;
 
   /* 
    * Run the analysis phase of ARIES.
    */
-  void analyze(vector <LogRecord*> log);
+  void analyze(const vector <LogRecord*>& log);
+
+  /*
+   * Run the analysis phase of ARIES over log[first] on, carrying on
+   * from the tables as they are.
+   */
+  void analyzeFrom(const vector <LogRecord*>& log, size_t first);
 
   /*
-   * Run the redo phase of ARIES.
+   * The LSN redo starts from: the least recLSN in the dirty page table,
+   * or NULL_LSN if it is empty and there is nothing to redo.
+   */
+  int redoLSN();
+
+  /*
+   * Run the redo phase of ARIES, from redoLSN() on; log must be in
+   * LSN order. With the engine's page sorted redo on, the records are
+   * applied page by page instead of in log order.
    * If the StorageEngine stops responding, return false.
    * Else when redo phase is complete, return true. 
    */
-  bool redo(vector <LogRecord*> log);
+  bool redo(const vector <LogRecord*>& log);
+
+  /*
+   * Log an end record for each committed transaction in the TX table
+   * and drop it from the table.
+   */
+  void endCommitted();
+
+  /*
+   * For page chain logging: returns the LSN of the latest record logged
+   * on page_id, or NULL_LSN if there is none, and makes lsn the latest.
+   */
+  int linkPageChain(int page_id, int lsn);
+
+  /*
+   * Puts page_id in the dirty page table, keeping an earlier recLSN.
+   */
+  void markDirty(int page_id, int lsn);
+
+  /*
+   * The logged record with this LSN, from the log tail or else parsed
+   * from the log flush on disk that holds it. Where the engine cannot
+   * find that flush, from log, the whole on-disk log text, which is
+   * read into it the first time it is needed. Records parsed are added
+   * to parsed for the caller to delete. NULL if there is none.
+   */
+  LogRecord* findRecord(int lsn, string& log, bool& logRead, vector <LogRecord*>& parsed);
+
+  /*
+   * For an instant restart, in place of redo and undo: note the records
+   * each dirty page needs redone and the pages each loser wrote, to be
+   * recovered when first asked for. After redone, as with background
+   * undo, only the losers are left for later.
+   */
+  void deferRecovery(const vector <LogRecord*>& log, bool redone);
 
   /*
    * If no txnum is specified, run the undo phase of ARIES.
@@ -61,7 +209,14 @@ class LogMgr {
    * Hint: the logic is very similar for these two tasks!
    */
   void undo(vector <LogRecord*> log, int txnum = NULL_TX);
-  vector<LogRecord*> stringToLRVector(string logstring);
+
+  /*
+   * Roll back the transactions in losers together, as undo does. Adds
+   * the pages written to pageWrites; returns false if the StorageEngine
+   * stops accepting writes.
+   */
+  bool rollback(const vector <LogRecord*>& log, const vector <int>& losers, long& pageWrites);
+  vector<LogRecord*> stringToLRVector(const string& logstring);
   
  public:
   /*
@@ -80,6 +235,53 @@ class LogMgr {
    */
   void commit(int txid);
 
+  /*
+   * Whether txid can be a transaction's id: the TX table keeps one slot
+   * per id up to DenseTable's MAX_ID. Prints an error if not. Writes,
+   * commits and aborts of any other txid are refused unlogged.
+   */
+  static bool validTxid(int txid);
+
+  /*
+   * The steps of commit, for callers that make several commits durable
+   * with one flush: commitRecord logs the commit record and returns its
+   * LSN, forceLog flushes the log tail up to an LSN, and endCommit logs
+   * the end record once the commit record is on disk.
+   */
+  int commitRecord(int txid);
+  void forceLog(int lsn);
+  void endCommit(int txid, int commitLsn);
+
+  /*
+   * Commits txid without waiting for the log: the commit record is
+   * logged and its LSN returned. The commit is durable once
+   * flushedLSN() reaches that LSN, within the engine's async commit
+   * bounds, or at once after waitDurable. commit does this itself when
+   * the engine's async commit is on. A crash before then rolls the
+   * transaction back.
+   */
+  int commitAsync(int txid);
+
+  /*
+   * The highest LSN that is on disk with every record before it.
+   * waitDurable forces the log up to lsn unless it is there already.
+   * flushCommits makes every async commit durable, as for a clean
+   * shutdown.
+   */
+  int flushedLSN();
+  void waitDurable(int lsn);
+  void flushCommits();
+
+  /*
+   * For async commit: logs the end records of the pending commits that
+   * are on disk, then forces the log up to the latest pending commit if
+   * the oldest has waited the engine's delay bound or the log tail has
+   * grown to its byte bound. Called as each piece of work comes in, and
+   * by the engine's commit flusher at the delay bound when none does;
+   * end() forces the rest.
+   */
+  void flushDueCommits();
+
   /*
    * A function that StorageEngine will call when it's about to 
    * write a page to disk. 
@@ -88,15 +290,87 @@ class LogMgr {
   void pageFlushed(int page_id);
 
   /*
-   * Recover from a crash, given the log from the disk.
+   * Recover from a crash, given the log from the disk. After
+   * resumeRecovery, log is only what follows the first
+   * recoveredLogBytes() of it.
    */
   void recover(string log);
 
+  /*
+   * For a crash during previous's recovery: takes over the log previous
+   * parsed and the tables its analysis built, so that recover() only
+   * parses and analyzes the log written since. Call before the crash.
+   */
+  void resumeRecovery(LogMgr& previous);
+
+  /*
+   * How many bytes at the start of the log recover() has already
+   * parsed. 0 unless resumeRecovery was called.
+   */
+  size_t recoveredLogBytes();
+
+  /*
+   * After an instant restart or with background undo, the recovery
+   * recover() left for later. recoveryDeferred tells whether any is
+   * left. recoverPage brings a page up to date: it redoes the page's
+   * records and rolls back every loser that wrote it. recoverTx rolls back txid if it is a loser not
+   * yet rolled back. recoverNextPage recovers the deferred page with the
+   * lowest id, or else the next loser. Losers that wrote a common page
+   * are rolled back together, as one undo would. Each returns false
+   * once the StorageEngine stops accepting writes.
+   */
+  bool recoveryDeferred();
+  bool recoverPage(int page_id);
+  bool recoverTx(int txid);
+  bool recoverNextPage();
+
+  /*
+   * With page chain logging, the writes that bring page_id from the
+   * image whose page LSN is after_lsn to its latest logged state: each
+   * update and CLR on the page above after_lsn, oldest first, with its
+   * LSN in lsns. Only the page's own records are read, by walking its
+   * chain back from the latest. Returns false if the chain breaks
+   * first, as it does at a record logged without page chains.
+   */
+  bool pageChain(int page_id, int after_lsn, vector<WriteOp>& writes, vector<int>& lsns);
+
+  /*
+   * The dirty page table as (recLSN, page) pairs, oldest recLSN first.
+   */
+  void dirtyPagesByAge(vector <pair<int, int> >& pages);
+
+  /*
+   * The LSN a restart now would start redo from, NULL_LSN if it would
+   * redo nothing. Without the engine's page flush logging that is no
+   * later than the least recLSN of the last checkpoint's dirty page
+   * table, however many of its pages have been written back since.
+   */
+  int restartRedoLSN();
+
+  /*
+   * About how many bytes of the log on disk are at lsn or after it:
+   * what a restart would redo if lsn were the least recLSN. Only kept
+   * with the engine's recovery time target set.
+   */
+  unsigned long logBytesSince(int lsn);
+
+  /*
+   * How long the phases of the last recover() took.
+   */
+  RecoveryStats getRecoveryStats();
+
   /*
    * Logs an update to the database and updates tables if needed.
    */
   int write(int txid, int page_id, int offset, string input, string oldtext);
 
+  /*
+   * Logs a group of updates for one transaction, olds[i] being the
+   * before-image of ops[i]. The records get consecutive LSNs in the
+   * order of ops; returns the first of them.
+   */
+  int writeBatch(int txid, const vector<WriteOp>& ops, const vector<string>& olds);
+
   /*
    * Sets this.se to engine. 
    */
@@ -104,10 +378,14 @@ class LogMgr {
 
   //destructor
   ~LogMgr() {
+    if (se)
+      se->cancelCommitFlush(this);
     while (!logtail.empty()) {
       delete logtail[0];
       logtail.erase(logtail.begin());
     }
+    for (unsigned i = 0; i < recovered_log.size(); ++i)
+      delete recovered_log[i];
   }
   //copy constructor omitted
   //Overloaded assignment operator
@@ -132,6 +410,8 @@ class LogMgr {
 	string after = ulr->getAfterImage();
 	UpdateLogRecord* cpy_lr = new UpdateLogRecord(lsn, prevLSN, txid, page_id, offset, 
 						      before, after);
+	if (ulr->hasPageChain())
+	  cpy_lr->setPagePrevLSN(ulr->getPagePrevLSN());
 	logtail.push_back(cpy_lr);
       } else if (type == CLR) {
 	CompensationLogRecord* clr = dynamic_cast<CompensationLogRecord *>(lr);
@@ -141,12 +421,13 @@ class LogMgr {
 	int nextLSN = clr->getUndoNextLSN();
 	CompensationLogRecord* cpy_lr = new CompensationLogRecord(lsn, prevLSN, txid, page_id, offset, 
 								  after, nextLSN);
+	if (clr->hasPageChain())
+	  cpy_lr->setPagePrevLSN(clr->getPagePrevLSN());
 	logtail.push_back(cpy_lr);
       } else if (type == END_CKPT) {
 	ChkptLogRecord * chk_ptr = dynamic_cast<ChkptLogRecord *>(lr);
-	map <int, txTableEntry> tx_table = chk_ptr->getTxTable();
-	map <int, int> dp_table = chk_ptr->getDirtyPageTable();
-	ChkptLogRecord * cpy_lr = new ChkptLogRecord(lsn, prevLSN, txid, tx_table, dp_table);
+	ChkptLogRecord * cpy_lr = new ChkptLogRecord(lsn, prevLSN, txid, chk_ptr->getTxTable(),
+						     chk_ptr->getDirtyPageTable());
 	logtail.push_back(cpy_lr);
       } else { //type is ordinary log record
 	LogRecord * cpy_lr = new LogRecord(lsn, prevLSN, txid, type);
@@ -156,6 +437,8 @@ class LogMgr {
     se = rhs.se;
     tx_table = rhs.tx_table;
     dirty_page_table = rhs.dirty_page_table;
+    tx_first_lsn = rhs.tx_first_lsn;
+    page_chain_heads = rhs.page_chain_heads;
     return *this;
     
   }
@@ -1,8 +1,123 @@
 #include "LogRecord.h"
+#include <cctype>
+#include <charconv>
+#include <cstring>
 #include <sstream>
 
 using namespace std;
 
+namespace {
+
+// The tab-separated fields of a log line, as [begin, end) ranges.
+struct LineFields {
+  enum { MAX = 9 };
+  const char* begin[MAX];
+  const char* end[MAX];
+  int count;
+
+  bool is(int i, const char* word) const {
+    size_t n = strlen(word);
+    return (size_t)(end[i] - begin[i]) == n && memcmp(begin[i], word, n) == 0;
+  }
+  string str(int i) const { return string(begin[i], end[i]); }
+};
+
+// Splits a line at its tabs. False if it has more than MAX fields.
+bool splitFields(const char* line, const char* line_end, LineFields& fields) {
+  fields.count = 0;
+  while (fields.count < LineFields::MAX) {
+    const char* tab = (const char*)memchr(line, '\t', line_end - line);
+    fields.begin[fields.count] = line;
+    fields.end[fields.count] = tab ? tab : line_end;
+    ++fields.count;
+    if (tab == NULL)
+      return true;
+    line = tab + 1;
+  }
+  return false;
+}
+
+// Reads [begin, end) as one int, or fails.
+bool readInt(const char* begin, const char* end, int& value) {
+  from_chars_result result = from_chars(begin, end, value);
+  return begin != end && result.ec == errc() && result.ptr == end;
+}
+
+bool readInt(const LineFields& fields, int i, int& value) {
+  return readInt(fields.begin[i], fields.end[i], value);
+}
+
+// Whether field i is what operator>> would read as one string.
+bool isToken(const LineFields& fields, int i) {
+  if (fields.begin[i] == fields.end[i])
+    return false;
+  for (const char* c = fields.begin[i]; c != fields.end[i]; ++c) {
+    if (isspace((unsigned char)*c))
+      return false;
+  }
+  return true;
+}
+
+// Reads the int at p that is followed by stop, and moves p past stop.
+bool readIntBefore(const char*& p, const char* end, char stop, int& value) {
+  const char* at = (const char*)memchr(p, stop, end - p);
+  if (at == NULL || !readInt(p, at, value))
+    return false;
+  p = at + 1;
+  return true;
+}
+
+// Appends value in decimal, as to_string would write it, without a
+// temporary string.
+void appendInt(string& buffer, int value) {
+  char digits[12];
+  to_chars_result result = to_chars(digits, digits + sizeof(digits), value);
+  buffer.append(digits, result.ptr - digits);
+}
+
+bool skip(const char*& p, const char* end, const char* text) {
+  size_t n = strlen(text);
+  if ((size_t)(end - p) < n || memcmp(p, text, n) != 0)
+    return false;
+  p += n;
+  return true;
+}
+
+/*
+ * Reads a transaction table as ChkptLogRecord writes it,
+ * "{ [ txid lastLSN U ] [ txid lastLSN C ]}". An empty "{}" is refused:
+ * stringToRecordPtr reads the dirty page table in its place.
+ */
+bool readTxTable(const char* p, const char* end, DenseTable<txTableEntry>& table) {
+  if (!skip(p, end, "{") || p == end || *p == '}')
+    return false;
+  while (skip(p, end, " [ ")) {
+    int txid, lastLSN;
+    if (!readIntBefore(p, end, ' ', txid) || !readIntBefore(p, end, ' ', lastLSN)
+	|| end - p < 3 || (*p != 'U' && *p != 'C') || p[1] != ' ' || p[2] != ']')
+      return false;
+    table.insert(txid, txTableEntry(lastLSN, *p == 'U' ? U : C));
+    p += 3;
+  }
+  return skip(p, end, "}") && p == end;
+}
+
+// Reads a dirty page table, "{ [ page recLSN ] [ page recLSN ]}" or "{}".
+bool readIntTable(const char* p, const char* end, DenseTable<int>& table) {
+  if (!skip(p, end, "{"))
+    return false;
+  while (skip(p, end, " [ ")) {
+    int page, recLSN;
+    if (!readIntBefore(p, end, ' ', page) || !readIntBefore(p, end, ' ', recLSN)
+	|| !skip(p, end, "]"))
+      return false;
+    table.insert(page, recLSN);
+  }
+  return skip(p, end, "}") && p == end;
+}
+
+}
+
 LogRecord* LogRecord::stringToRecordPtr(string rec_string){
   stringstream ss(rec_string);
   int lsn, prevLSN, txID;
@@ -15,6 +130,9 @@ LogRecord* LogRecord::stringToRecordPtr(string rec_string){
     string before_image, after_image;
     ss >> pageID >> offset >> before_image >> after_image;
     UpdateLogRecord* ulr = new UpdateLogRecord(lsn, prevLSN, txID, pageID, offset, before_image, after_image); 
+    int pagePrevLSN;
+    if (ss >> pagePrevLSN)
+      ulr->setPagePrevLSN(pagePrevLSN);
     return ulr;
   } else if (str_type == "CLR") {
     type = CLR;
@@ -24,12 +142,18 @@ LogRecord* LogRecord::stringToRecordPtr(string rec_string){
     CompensationLogRecord* clr = new CompensationLogRecord(lsn,prevLSN, txID,
 							  pageID, offset, after_image,
 							  undoNextLSN);
-
+    int pagePrevLSN;
+    if (ss >> pagePrevLSN)
+      clr->setPagePrevLSN(pagePrevLSN);
     return clr;
+  } else if (str_type == "end_write") {
+    int pageID;
+    ss >> pageID;
+    return new EndWriteLogRecord(lsn, prevLSN, txID, pageID);
   } else if (str_type == "end_checkpoint") {
     type = END_CKPT;
-    map<int, txTableEntry> txmap;
-    map<int, int> dirtypagemap;
+    DenseTable<txTableEntry> txmap;
+    DenseTable<int> dirtypagemap;
     string curly;
     ss >> curly;
     //parse the tx table map
@@ -37,19 +161,37 @@ LogRecord* LogRecord::stringToRecordPtr(string rec_string){
     getline(ss, txmapstr, '}');
     stringstream ss2(txmapstr);
     string item;
+    //An empty transaction table is read as the whole of "{}", so the
+    //dirty page table is read as the transaction table and comes out
+    //empty: in "{} { [ 4 2 ] [ 9 3 ]}", "{ [ 4 2" is transaction 0 with
+    //no lastLSN read and "[ 9 3" is transaction 9 with lastLSN 3. This
+    //is the baseline's reading, kept because the end records analysis
+    //writes for those transactions are in the expected logs in correct/
+    //("34 3 0 end" in log01). The baseline left the lastLSN of an entry
+    //cut short uninitialised, and it came out as the lastLSN of the last
+    //whole entry only because an earlier parse of the record had left
+    //that on the stack. Resumed recovery parses each record once, so
+    //that value is now set explicitly. test13 covers it.
+    vector<int> cut_short;
+    int last_whole = 0;
     while (getline(ss2, item, ']')) {
       stringstream ss3(item);
       string square, status_str;
-      int tx_int, lastLSN;
-      ss3 >> square >> tx_int >> lastLSN >> status_str;
+      int tx_int, lastLSN = 0;
+      bool whole = (bool)(ss3 >> square >> tx_int >> lastLSN);
+      ss3 >> status_str;
       TxStatus status;
       if (status_str == "U")
 	status = U;
       else
 	status = C;
-      txTableEntry entry = txTableEntry(lastLSN, status);
-      txmap.insert(pair<int, txTableEntry>(tx_int, entry));
+      if (whole)
+	last_whole = lastLSN;
+      if (txmap.insert(tx_int, txTableEntry(lastLSN, status)) && !whole)
+	cut_short.push_back(tx_int);
     }
+    for (unsigned i = 0; i < cut_short.size(); ++i)
+      txmap[cut_short[i]].lastLSN = last_whole;
     ss >> curly;
     //parse the dirty page table map
     string dpmapstr;
@@ -61,7 +203,7 @@ LogRecord* LogRecord::stringToRecordPtr(string rec_string){
       string square;
       int i, j;
       ss3 >> square >> i >> j;
-      dirtypagemap.insert(pair<int, int>(i,j));
+      dirtypagemap.insert(i, j);
     }
     ChkptLogRecord* chlr = new ChkptLogRecord(lsn, prevLSN, txID, 
 					      txmap, dirtypagemap);
@@ -83,119 +225,186 @@ LogRecord* LogRecord::stringToRecordPtr(string rec_string){
   
 }
 
+LogRecord* LogRecord::parseRecord(const char* line, size_t length) {
+  LineFields f;
+  int lsn, prevLSN, txID;
+  LogRecord* record = NULL;
+  if (splitFields(line, line + length, f) && f.count >= 4 && readInt(f, 0, lsn)
+      && readInt(f, 1, prevLSN) && readInt(f, 2, txID)) {
+    int pageID, offset, undoNextLSN, pagePrevLSN;
+    //a ninth field is the page chain
+    bool chained = f.count == 9 && readInt(f, 8, pagePrevLSN);
+    if (f.is(3, "update")) {
+      if ((f.count == 8 || chained) && readInt(f, 4, pageID) && readInt(f, 5, offset)
+	  && isToken(f, 6) && isToken(f, 7)) {
+	UpdateLogRecord* update = new UpdateLogRecord(lsn, prevLSN, txID, pageID, offset,
+						      f.str(6), f.str(7));
+	if (chained)
+	  update->setPagePrevLSN(pagePrevLSN);
+	record = update;
+      }
+    } else if (f.is(3, "CLR")) {
+      if ((f.count == 8 || chained) && readInt(f, 4, pageID) && readInt(f, 5, offset)
+	  && isToken(f, 6) && readInt(f, 7, undoNextLSN)) {
+	CompensationLogRecord* clr = new CompensationLogRecord(lsn, prevLSN, txID, pageID, offset,
+							       f.str(6), undoNextLSN);
+	if (chained)
+	  clr->setPagePrevLSN(pagePrevLSN);
+	record = clr;
+      }
+    } else if (f.is(3, "end_write")) {
+      if (f.count == 5 && readInt(f, 4, pageID))
+	record = new EndWriteLogRecord(lsn, prevLSN, txID, pageID);
+    } else if (f.is(3, "end_checkpoint")) {
+      DenseTable<txTableEntry> txmap;
+      DenseTable<int> dirtypagemap;
+      if (f.count == 6 && readTxTable(f.begin[4], f.end[4], txmap)
+	  && readIntTable(f.begin[5], f.end[5], dirtypagemap))
+	record = new ChkptLogRecord(lsn, prevLSN, txID, txmap, dirtypagemap);
+    } else if (f.count == 4) {
+      if (f.is(3, "commit"))
+	record = new LogRecord(lsn, prevLSN, txID, COMMIT);
+      else if (f.is(3, "abort"))
+	record = new LogRecord(lsn, prevLSN, txID, ABORT);
+      else if (f.is(3, "end"))
+	record = new LogRecord(lsn, prevLSN, txID, END);
+      else if (f.is(3, "begin_checkpoint"))
+	record = new LogRecord(lsn, prevLSN, txID, BEGIN_CKPT);
+    }
+  }
+  if (record == NULL) //not as toString writes it; let the old parser decide
+    record = stringToRecordPtr(string(line, length));
+  return record;
+}
+
 string LogRecord::toString() {
-  string result = basicToString();
-  result.append("\n");
+  string result;
+  serializeInto(result);
   return result;
 }
 
-string LogRecord::basicToString() {
-    string result = "";
-    result.append(to_string(lsn));
-    result.append("\t");
-    result.append(to_string(prevLSN));
-    result.append("\t");
-    result.append(to_string(txID));
-    result.append("\t");
+void LogRecord::serializeInto(string& buffer) {
+  basicSerializeInto(buffer);
+  buffer += '\n';
+}
+
+void LogRecord::basicSerializeInto(string& buffer) {
+    appendInt(buffer, lsn);
+    buffer += '\t';
+    appendInt(buffer, prevLSN);
+    buffer += '\t';
+    appendInt(buffer, txID);
+    buffer += '\t';
 
     switch (type) {
     case UPDATE:
-      result.append("update");
+      buffer.append("update");
       break;
     case COMMIT:
-      result.append("commit");
+      buffer.append("commit");
       break;
     case ABORT:
-      result.append("abort");
+      buffer.append("abort");
       break;
     case END:
-      result.append("end");
+      buffer.append("end");
       break;
     case CLR:
-      result.append("CLR");
+      buffer.append("CLR");
       break;
     case BEGIN_CKPT:
-      result.append("begin_checkpoint");
+      buffer.append("begin_checkpoint");
       break;
     case END_CKPT:
-      result.append("end_checkpoint");
+      buffer.append("end_checkpoint");
       break;    
+    case END_WRITE:
+      buffer.append("end_write");
+      break;
     }
-    
-    return result;
   }
 
 
 
-string UpdateLogRecord::toString() {
-  string result = basicToString();
-  result.append("\t");
-  result.append(to_string(pid));
-  result.append("\t");
-  result.append(to_string(offset));
-  result.append("\t");
-  result.append(beforeImage);
-  result.append("\t");
-  result.append(afterImage);
-  result.append("\n");
-  return result;
+void UpdateLogRecord::serializeInto(string& buffer) {
+  basicSerializeInto(buffer);
+  buffer += '\t';
+  appendInt(buffer, pid);
+  buffer += '\t';
+  appendInt(buffer, offset);
+  buffer += '\t';
+  buffer.append(beforeImage);
+  buffer += '\t';
+  buffer.append(afterImage);
+  if (pageChained) {
+    buffer += '\t';
+    appendInt(buffer, pagePrevLSN);
+  }
+  buffer += '\n';
 }
 
 
 
-string CompensationLogRecord::toString() {
-  string result = basicToString();
-  result.append("\t");
-  result.append(to_string(pageID));
-  result.append("\t");
-  result.append(to_string(offset));
-  result.append("\t");
-  result.append(afterImage);
-  result.append("\t");
-  result.append(to_string(undoNextLSN));
-  result.append("\n");
-  return result;
+void CompensationLogRecord::serializeInto(string& buffer) {
+  basicSerializeInto(buffer);
+  buffer += '\t';
+  appendInt(buffer, pageID);
+  buffer += '\t';
+  appendInt(buffer, offset);
+  buffer += '\t';
+  buffer.append(afterImage);
+  buffer += '\t';
+  appendInt(buffer, undoNextLSN);
+  if (pageChained) {
+    buffer += '\t';
+    appendInt(buffer, pagePrevLSN);
+  }
+  buffer += '\n';
 }
 
-string ChkptLogRecord::toString() {
-  string result = basicToString();
-  result.append("\t");
-  result.append(txMapToString(txTable));
-  result.append("\t");
-  result.append(intMapToString(dirtyPageTable));
-  result.append("\n");
-  return result;
+void EndWriteLogRecord::serializeInto(string& buffer) {
+  basicSerializeInto(buffer);
+  buffer += '\t';
+  appendInt(buffer, pageID);
+  buffer += '\n';
+}
+
+void ChkptLogRecord::serializeInto(string& buffer) {
+  basicSerializeInto(buffer);
+  buffer += '\t';
+  appendTxTable(buffer, txTable);
+  buffer += '\t';
+  appendIntTable(buffer, dirtyPageTable);
+  buffer += '\n';
 }
 
-string ChkptLogRecord::intMapToString(map <int, int> myMap) {
-  string result = "{";
-  for (map<int,int>::iterator it = myMap.begin(); 
-	 it != myMap.end(); ++it) {
-    result.append(" [ ");
-    result.append(to_string(it->first));
-    result.append(" ");
-    result.append(to_string(it->second));
-    result.append(" ]");
+void ChkptLogRecord::appendIntTable(string& buffer, const DenseTable <int>& table) {
+  buffer += '{';
+  for (DenseTable<int>::const_iterator it = table.begin(); 
+	 it != table.end(); ++it) {
+    buffer.append(" [ ");
+    appendInt(buffer, it->first);
+    buffer += ' ';
+    appendInt(buffer, it->second);
+    buffer.append(" ]");
   } 
-  result.append("}");
-  return result;
+  buffer += '}';
 }
 
-string ChkptLogRecord::txMapToString(map <int, txTableEntry> myMap) {
-  string result = "{";
-  for (map<int,txTableEntry>::iterator it = myMap.begin(); 
-	 it != myMap.end(); ++it) {
-    result.append(" [ ");
-    result.append(to_string(it->first));
-    result.append(" ");
-    result.append(to_string((it->second).lastLSN));
-    result.append(" ");
+void ChkptLogRecord::appendTxTable(string& buffer, const DenseTable <txTableEntry>& table) {
+  buffer += '{';
+  for (DenseTable<txTableEntry>::const_iterator it = table.begin(); 
+	 it != table.end(); ++it) {
+    buffer.append(" [ ");
+    appendInt(buffer, it->first);
+    buffer += ' ';
+    appendInt(buffer, (it->second).lastLSN);
+    buffer += ' ';
     if ((it->second).status == U)
-      result.append("U");
+      buffer += 'U';
     else
-      result.append("C");
-    result.append(" ]");
+      buffer += 'C';
+    buffer.append(" ]");
   } 
-  result.append("}");
-  return result;
+  buffer += '}';
 }
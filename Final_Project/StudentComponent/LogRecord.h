@@ -1,15 +1,16 @@
 #include <string>
 #include <map>
+#include "DenseTable.h"
 
 using namespace std;
 
 enum TxStatus {U, C};
-enum TxType {UPDATE, COMMIT, ABORT, END, CLR, BEGIN_CKPT, END_CKPT};
+enum TxType {UPDATE, COMMIT, ABORT, END, CLR, BEGIN_CKPT, END_CKPT, END_WRITE};
 
 struct txTableEntry {
   int lastLSN;
   TxStatus status;
-  txTableEntry(){};
+  txTableEntry() : lastLSN(-1), status(U) {};
   txTableEntry(int lsn, TxStatus stat) {lastLSN=lsn; status=stat; };
 };
 
@@ -22,7 +23,16 @@ class LogRecord {
 
   static LogRecord* stringToRecordPtr(string rec_string);
 
-  virtual string toString();
+  // Same result as stringToRecordPtr for a line of length bytes (no
+  // newline), without building streams. Lines toString could not have
+  // written are handed to stringToRecordPtr.
+  static LogRecord* parseRecord(const char* line, size_t length);
+
+  string toString();
+
+  // Appends the record as one line of the text log to buffer. Allocates
+  // only when buffer has to grow, so a reused buffer costs nothing.
+  virtual void serializeInto(string& buffer);
 
   virtual ~LogRecord() {}
 
@@ -38,9 +48,9 @@ class LogRecord {
   int txID;
   TxType type;
 
-  //Make a string with the lsn, prevLSN, txID, and type
-  //for use in this and the subclass toString functions
-  string basicToString();  
+  //Append the lsn, prevLSN, txID, and type to buffer
+  //for use in this and the subclass serializeInto functions
+  void basicSerializeInto(string& buffer);
 };
 ///////////////////  End LogRecord  ///////////////////
 
@@ -56,6 +66,8 @@ class UpdateLogRecord : public LogRecord{
         offset = page_offset;
         beforeImage = before_img;
         afterImage = after_img;
+        pagePrevLSN = -1;
+        pageChained = false;
     }
 
 
@@ -65,13 +77,21 @@ class UpdateLogRecord : public LogRecord{
   string getBeforeImage() {return beforeImage;}
   string getAfterImage() {return afterImage;}
 
-  virtual string toString();
+  // With page chain logging, the LSN of the previous update or CLR on
+  // the same page (-1 for its first), written after the images.
+  void setPagePrevLSN(int lsn) {pagePrevLSN = lsn; pageChained = true;}
+  int getPagePrevLSN() {return pagePrevLSN;}
+  bool hasPageChain() {return pageChained;}
+
+  virtual void serializeInto(string& buffer);
 
  private:
   int pid;
   int offset;
   string beforeImage;
   string afterImage;
+  int pagePrevLSN;
+  bool pageChained;
 };
 ///////////////////  End UpdateLogRecord  ///////////////////
 
@@ -83,43 +103,66 @@ class CompensationLogRecord : public LogRecord{
 		       string after_img, int undo_next_lsn) :
   LogRecord(lsn_in, prev_lsn, tx_id, CLR), pageID(page_id),
     offset(page_offset), afterImage(after_img),
-    undoNextLSN(undo_next_lsn) {}
+    undoNextLSN(undo_next_lsn), pagePrevLSN(-1), pageChained(false) {}
 
-  virtual string toString();
+  virtual void serializeInto(string& buffer);
 
   int getPageID() {return pageID;}
   int getOffset() {return offset;}
   string getAfterImage() {return afterImage;}
   int getUndoNextLSN() {return undoNextLSN;}
+
+  // As for an update record; written after undoNextLSN.
+  void setPagePrevLSN(int lsn) {pagePrevLSN = lsn; pageChained = true;}
+  int getPagePrevLSN() {return pagePrevLSN;}
+  bool hasPageChain() {return pageChained;}
  private: 
   int pageID;
   int offset;
   string afterImage; 
   //Unlike an update record, only need redo info, not undo info!
   int undoNextLSN;
+  int pagePrevLSN;
+  bool pageChained;
 };
 
 ///////////////////  End CompenstationLogRecord  ///////////////////
 
+///////////////////  EndWriteLogRecord  ///////////////////
+// Marks that a page was written to disk, with every update below this
+// record's LSN on it. Belongs to no transaction.
+class EndWriteLogRecord : public LogRecord{
+ public:
+ EndWriteLogRecord(int lsn_in, int prev_lsn, int tx_id, int page_id) :
+  LogRecord(lsn_in, prev_lsn, tx_id, END_WRITE), pageID(page_id) {}
+
+  virtual void serializeInto(string& buffer);
+
+  int getPageID() {return pageID;}
+ private:
+  int pageID;
+};
+///////////////////  End EndWriteLogRecord  ///////////////////
+
 /////////////////// ChkptLogRecord  ///////////////////
 class ChkptLogRecord : public LogRecord{
  public:
   ChkptLogRecord(int lsn_in, int prev_lsn, int tx_id, 
-		      map <int,txTableEntry> tx_table, 
-		      map <int,int> dirty_page_table) :
+		      const DenseTable <txTableEntry>& tx_table, 
+		      const DenseTable <int>& dirty_page_table) :
   LogRecord(lsn_in, prev_lsn, tx_id, END_CKPT), txTable(tx_table),
     dirtyPageTable(dirty_page_table)
     {}
 
-  map <int,txTableEntry> getTxTable() {return txTable;}
-  map <int,int> getDirtyPageTable() {return dirtyPageTable;}
-  virtual string toString();
+  const DenseTable <txTableEntry>& getTxTable() {return txTable;}
+  const DenseTable <int>& getDirtyPageTable() {return dirtyPageTable;}
+  virtual void serializeInto(string& buffer);
  private:
-  map <int,txTableEntry> txTable;
-  map <int,int> dirtyPageTable;  
+  DenseTable <txTableEntry> txTable;
+  DenseTable <int> dirtyPageTable;  
 
-  string intMapToString(map <int, int> myMap);
-  string txMapToString(map <int, txTableEntry> myMap);
+  static void appendIntTable(string& buffer, const DenseTable <int>& table);
+  static void appendTxTable(string& buffer, const DenseTable <txTableEntry>& table);
 };
 
 
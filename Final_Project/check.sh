@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# Runs every testcase and compares the database and the log files it
+# leaves in output/ with correct/. Testcases 10 on each cover one engine
+# mode and run with that mode's driver options, if it has any; see the
+# list below.
+# Run from Final_Project after make, or as make check. Prints a FAIL
+# line for each mismatch and exits 1 if there was any.
+
+fail=0
+
+# check num [driver options]
+check() {
+  num=$1
+  shift
+  rm -f output/dbs/db$num.db output/log/log$num.*
+  ./main.o testcases/test$num "$@" > /dev/null 2>&1
+  cmp -s output/dbs/db$num.db correct/dbs/db$num.db ||
+    { echo "FAIL db$num $*"; fail=1; }
+  # a segmented log is several files; every one must match, and no
+  # other may be left
+  for f in correct/logs/log$num.*; do
+    cmp -s "$f" "output/log/${f#correct/logs/}" ||
+      { echo "FAIL ${f#correct/logs/} $*"; fail=1; }
+  done
+  for f in output/log/log$num.*; do
+    [ ! -e "$f" ] || [ -e "correct/logs/${f#output/log/}" ] ||
+      { echo "FAIL ${f#output/log/} not expected $*"; fail=1; }
+  done
+}
+
+for num in 00 01 02 03 04 05 06 07 08 09; do
+  check $num
+done
+check 10 --write-batch
+check 11 --page-chain-log
+check 12 --log-segment-bytes 100
+# the checkpoints after the first updates drop the sealed segments
+# before them, and the crash that follows recovers without them
+for f in output/log/log12.2-4.log output/log/log12.5-7.log; do
+  [ ! -e $f ] || { echo "FAIL $f not truncated"; fail=1; }
+done
+# a checkpoint with an empty transaction table, read by each restart of
+# a nested crash
+check 13
+check 14 --diff-log
+check 15 --compress-log
+check 16 --instant-restart
+check 17 --background-undo
+# a delay no run reaches, so only checkpoints, page write-backs and
+# end() force the log
+check 18 --async-commit 100000
+# the estimate uses a fixed restart rate until a restart has been
+# timed, so test19 crashes only after its last write
+check 19 --recovery-target-ms 0.02
+check 20 --log-page-flushes
+# redo never has to evict in these, so replaying the pages in page order
+# must leave the same database and log as log order
+for num in 00 01 02 04 07 08 09; do
+  check $num --page-sorted-redo
+done
+
+[ $fail = 0 ] && echo "ALL PASS"
+exit $fail